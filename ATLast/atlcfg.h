@@ -23,26 +23,35 @@
 #define MEMSTAT
 #endif
 
-#ifndef READONLYSTRINGS
-#define READONLYSTRINGS
-#endif
-
 //#define ARRAY                   /* Array subscripting words */
 //#define BREAK                   /* Asynchronous break facility */
+//#define CLONE                   /* atl_clone and atl_reset (implies IMAGE) */
 //#define COMPILERW               /* Compiler-writing words */
 //#define CONIO                   /* Interactive console I/O */
 //#define DEFFIELDS               /* Definition field access for words */
+//#define DIRECTTHREAD            /* Direct-threaded inner interpreter (gcc/clang) */
 //#define DOUBLE                  /* Double word primitives (2DUP) */
 //#define EVALUATE                /* The EVALUATE primitive */
 //#define FILEIO                  /* File I/O primitives */
+//#define FPSTACK                 /* Reals on a stack of their own */
+//#define IMAGE                   /* Save and load images of compiled code */
+//#define JIT                     /* Machine code for colon definitions (x86-64) */
+//#define LINEARLOOKUP            /* Look words up by walking dict (to compare) */
+//#define LOADCACHE               /* Cache compiled source files (see cachePath) */
 //#define MATH                    /* Math functions */
 //#define MEMMESSAGE              /* Print message for stack/heap errors */
 //#define PROLOGUE                /* Prologue processing and auto-init */
 //#define REAL                    /* Floating point numbers */
 //#define SHORTCUTA               /* Shortcut integer arithmetic words */
 //#define SHORTCUTC               /* Shortcut integer comparison */
+//#define SIMDSCAN                /* Scan source 16 bytes at a time (SSE2) */
+//#define STACKEFFECT             /* Check stack depth once per definition at ; */
+//#define STACKGUARD              /* Guard pages, not compares, catch stack overflow */
 //#define STRING                  /* String functions */
+//#define SUBTHREAD               /* Subroutine-threaded code for colon definitions (x86-64) */
+//#define SUPERINST               /* Fuse common word sequences at ; */
 //#define SYSTEM                  /* System command function */
+//#define VMRESERVE               /* Reserve large heap and stacks, committed as used */
 //#ifndef NOMEMCHECK
 //#define TRACE               /* Execution tracing */
 //#define WALKBACK            /* Walkback trace */
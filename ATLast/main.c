@@ -24,13 +24,46 @@
 
 #include "atlcfg.h"
 
+#if defined(JIT) || defined(SUBTHREAD)
+#   define NATIVECODE              /* Machine code generation */
+#endif
+#if defined(CLONE) && !defined(IMAGE)
+#   define IMAGE                   /* Clones are made from an image */
+#endif
+#if defined(LOADCACHE) || defined(IMAGE)
+#   define HEAPIMAGE               /* Relocatable saves of compiled code */
+#endif
+#ifdef NOMEMCHECK
+#   undef STACKEFFECT              /* Nothing to check */
+#   undef STACKGUARD               /* Nor to guard */
+#endif
+#ifndef NOMEMCHECK
+#   define STACKFLOOR              /* Stack bottoms compared on pops */
+#   ifdef STACKGUARD
+#       undef STACKEFFECT          /* Stack depth isn't compared */
+#   else
+#       define STACKCHECK          /* Stack tops compared on pushes */
+#   endif
+#endif
+#if defined(SIMDSCAN) && !defined(__SSE2__)
+#   undef SIMDSCAN                /* Scan a byte at a time */
+#endif
+
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <errno.h>
+#include <limits.h>
 #include <string.h>
 #include <signal.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#ifdef STACKGUARD
+#   include <setjmp.h>
+#endif
 
 #ifdef ALIGNMENT
 #   ifdef __TURBOC__
@@ -53,13 +86,32 @@ typedef long                 stackitem;
 
 typedef enum {atlFalse = 0, atlTrue = 1} Boolean;
 
+#ifdef SUPERINST
+// superinstruction rules, one bit each in fuseMask
+//
+#define FuseLitPlus       0   // (LIT) n +            -> (LIT+) n
+#define FuseLitEqQbranch  1   // (LIT) n = ?BRANCH o  -> (LIT=?BRANCH) n o
+#define FuseDupAt         2   // DUP @                -> (DUP@)
+#define FuseOverOver      3   // OVER OVER            -> 2DUP
+#define FuseIPlus         4   // I +                  -> (I+)
+#define FuseAtPlus        5   // @ +                  -> (@+)
+#define FuseRules         6
+#endif
+
 // internal state marker item
 //
 struct atl_statemark {
     stackitem  *mstack;     // Stack position marker
+#ifdef FPSTACK
+    atl_real   *mfstack;    // Floating point stack position marker
+#endif
     stackitem  *mheap;      // Heap allocation marker
     dictword ***mrstack;    // Return stack position marker
     dictword   *mdict;      // Dictionary marker
+    char       *mnames;     // Name arena allocation marker
+#ifdef NATIVECODE
+    unsigned char *mjit;    // Machine code arena marker
+#endif
 };
 
 // dictionary word entry
@@ -68,10 +120,48 @@ struct dw {
     struct dw *wnext;       // Next word in dictionary
     char      *wname;       // Word name.  The first character is
     // actually the word flags, including
-    // the (IMMEDIATE) bit.
+    // the (IMMEDIATE) bit.  It points into
+    // the word's struct dname.
     codeptr    wcode;       // Machine code implementation
 };
 
+// word name, kept in the name arena.  Everything a lookup compares
+// is together, and the hash chain runs through the names so that a
+// lookup doesn't touch the words it passes over.
+//
+struct dname {
+    struct dname  *nnext;   // Next name in the same hash bucket
+    struct dw     *nword;   // Word with this name
+    struct wordlist *nlist; // Wordlist the word is in
+    unsigned int   nhash;   // Hash of the name
+    unsigned char  nheap;   // Allocated on its own, not in the arena
+    unsigned char  nlen;    // Length of the name
+    char           nflags;  // Word flags (wname points here)
+    char           nname[1];// Name, upper case and nul terminated
+};
+
+// wordlist.  Each has hash buckets of its own over the words defined
+// in it, and a lookup searches only the wordlists in the search order.
+// FORTH-WORDLIST lives in atlenv; those made by WORDLIST are in the
+// heap, so FORGET and atl_unwind take them back with the heap.
+//
+#define Wordorder 8                   // most wordlists in the search order
+
+struct wordlist {
+    struct dname  **lhash;  // Hash buckets, newest word first in each
+    unsigned long   lmask;  // Number of hash buckets less one
+    long            lcount; // Words linked into the buckets
+    struct wordlist *lnext; // Next older wordlist made by WORDLIST
+};
+
+// name arena chunk.  Names are allocated in chunks of Namechunk bytes
+// and cut back, like the heap, by FORGET and atl_unwind.
+//
+struct namechunk {
+    struct namechunk *prev; // Chunk filled before this one
+    char  *top;             // End of this chunk
+};
+
 // primitive definition table entry
 //
 struct primfcn {
@@ -79,6 +169,17 @@ struct primfcn {
     codeptr pcode;
 };
 
+#ifdef STACKGUARD
+// where a fault in a stack's guard pages unwinds to: the innermost
+// atl_eval, atl_exec or atl_resume running
+//
+struct guardcatch {
+    sigjmp_buf jump;
+    struct guardcatch *outer;           // the catch this one hides
+    int     nesting;                    // execNesting when it was set
+};
+#endif
+
 // atlenv is the state of the interpreter/compiler. users are expected
 // to create and initialize the structure, then pass it to all calls
 // to the library. this slows down the overall speed but allows for
@@ -89,10 +190,18 @@ struct primfcn {
 struct atlenv {
     // public -- visible to calling programs
     atl_int allowRedefinition;          // Allow redefinition without issuing the "not unique" message.
+    char   *cachePath;                  // Prefix of compiled-code cache file names (LOADCACHE), NULL for none
+    atl_int enableFusion;               // Fuse superinstructions at ; if true
+    atl_int enableJit;                  // Translate definitions to machine code at ; if true
+    atl_int enableStackEffect;          // Check stack depth once per definition at ; if true
+    atl_int enableSubthread;            // Compile definitions to subroutine-threaded code at ; if true
     atl_int enableTrace;                // Tracing if true
     atl_int enableWalkback;             // Walkback enabled if true
+    atl_int execBudget;                 // Safe points atl_exec may pass before suspending, 0 for no limit
+    atl_int fstkLength;                 // Floating point stack length (FPSTACK)
     atl_int heapLength;                 // Heap length
     atl_int isIgnoringComment;          // Currently ignoring a comment
+    atl_int jitLength;                  // Machine code arena length
     atl_int lengthTempStringBuffer;     // Temporary string buffer length
     atl_int lineNumberLastLoadFailed;   // Line where last atl_load failed or zero if no error
     atl_int numberOfTempStringBuffers;  // Number of temporary string buffers
@@ -105,6 +214,14 @@ struct atlenv {
     dictword   *currentWord;            // Current word being executed
     dictword   *dict;                   // dictionary chain head
     dictword   *dictFirstProtectedEntry;// first protected item in dictionary
+    struct wordlist forth;              // FORTH-WORDLIST
+    struct wordlist *current;           // wordlist new definitions go in
+    struct wordlist *order[Wordorder];  // search order, first searched first
+    int         orderDepth;             // wordlists in the search order
+    struct wordlist *wordlists;         // wordlists made by WORDLIST, newest first
+    struct namechunk *names;            // name arena, current chunk
+    char       *nameAllocPtr;           // name arena allocation pointer
+    dictword   *dictPrimitives;         // block of dictionary items built from primt
     int         evalStatus;             // evaluator status
     stackitem  *heap;                   // allocation heap
     stackitem  *heapAllocPtr;           // heap allocation pointer
@@ -114,6 +231,11 @@ struct atlenv {
     int         idxCurrTempStringBuffer;// index into current temp string buffer
     char       *inputBuffer;            // current input buffer
     dictword  **ip;                     // instruction pointer
+#ifdef NATIVECODE
+    unsigned char *jitArena;            // machine code arena
+    unsigned char *jitPtr;              // machine code allocation pointer
+    unsigned char *jitTop;              // top of machine code arena
+#endif
     int       (*nextToken)(char **cp);
     dictword ***rstack;                 // return stack, root of allocated memory for the stack
     dictword ***rs;                     // return stack pointer
@@ -125,6 +247,12 @@ struct atlenv {
     stackitem  *stkBottom;              // pointer to stack bottom
     stackitem  *stkMaxExtent;           // stack maximum excursion
     stackitem  *stkTop;                 // pointer to stack top
+#ifdef FPSTACK
+    atl_real   *fstack;                 // floating point stack
+    atl_real   *fstk;                   // floating point stack pointer
+    atl_real   *fstkMaxExtent;          // floating point stack maximum excursion
+    atl_real   *fstkTop;                // floating point stack top
+#endif
     Boolean     tokPendingCompile;      // [COMPILE] pending
     Boolean     tokPendingDefine;       // token definition pending
     Boolean     tokPendingForget;       // forget pending
@@ -135,6 +263,32 @@ struct atlenv {
     dictword  **walkbackPointer;        // walkback trace pointer (stack trace?)
 
     volatile Boolean asyncBreakReceived;// asynchronous break received
+    Boolean     instrumented;           // run the instrumented inner interpreter
+    dictword  **parkedIp;               // ip set aside while switching loops
+    atl_int     fuel;                   // safe points left to the running atl_exec, 0 if no limit
+    int         execNesting;            // C calls running words, atl_exec's outermost
+    dictword  **suspendedIp;            // where atl_resume carries on
+#ifdef STACKGUARD
+    struct guardcatch *guardCatch;      // innermost catch for stack faults, NULL if none
+#endif
+    char       *preparedName;           // wname of the words atl_prepare makes
+#ifdef IMAGE
+    stackitem  *imageHeap;              // where an image starts (see imagemark)
+    dictword   *imageDict;              // dict there
+    unsigned long long imagePrint;      // fingerprint of the system there
+#endif
+#ifdef CLONE
+    struct primfcn **primTables;        // tables atl_primdef added after atl_init
+    int         primTableCount;
+    struct atlclone *clone;             // what atl_reset restores, NULL if not a clone
+#endif
+
+#ifdef SUPERINST
+    long        fuseMask;               // superinstruction rules enabled
+    Boolean     fuseProfiling;          // counting candidate sequences
+    codeptr     fuseHistory[2];         // last two primitives executed
+    long        fuseCounts[FuseRules];  // executions of each candidate sequence
+#endif
 
     // TODO: rename these
     char      **strbuf;                 // table of pointers to temp strings
@@ -157,10 +311,22 @@ struct atlenv {
     stackitem s_xdo;
     stackitem s_xloop;
     stackitem s_xqdo;
+#ifdef SUPERINST
+    stackitem s_2dup;
+    stackitem s_atplus;
+    stackitem s_dupat;
+    stackitem s_iplus;
+    stackitem s_liteqqbranch;
+    stackitem s_litplus;
+#endif
+#ifdef STACKEFFECT
+    stackitem s_stackcheck;
+#endif
 
     // token processing variables
     //
-    char        tokbuf[128];            // token buffer
+    char       *tokptr;                 // scanned token, where it lies in the input
+    size_t      toklen;                 // its length
     long        tokint;                 // scanned integer
     atl_real    tokreal;                // scanned real number
 
@@ -178,10 +344,12 @@ atlenv *atl__NewInterpreter(void);
 void    atl__Break(void);
 int     atl__LoadFile(const char **path, const char *fileName);
 void    atl__Mark(atl_statemark *mp);
+char   *atl__FindFile(const char **path, const char *fileName, struct stat *statBuf);
 char   *atl__ReadFile(const char **path, const char *fileName);
 
 // internal use functions
 //
+char   *alloc(unsigned int size);
 int     atl__ReadNextToken(char **cp);
 
 // Functions called by exported extensions.
@@ -190,8 +358,11 @@ stackitem *atl_body(dictword *dw);
 void       atl_error(char *kind);
 char      *atl_fgetsp(char *s, int n, FILE *stream);
 int        atl_exec(dictword *dw);
+int        atl_resume(void);
 dictword  *atl_lookup(char *name);
+dictword  *atl_prepare(char *sp);
 void       atl_primdef(struct primfcn *pt);
+void       atl_release(dictword *dw);
 dictword  *atl_vardef(char *name, int size);
 
 // entry points
@@ -201,6 +372,14 @@ int  atl_load(FILE *fp);
 void atl_init(void);
 void atl_memstat(void);
 void atl_unwind(atl_statemark *mp);
+#ifdef IMAGE
+int  atl_load_image(const char *path);
+int  atl_save_image(const char *path);
+#endif
+#ifdef CLONE
+atlenv *atl_clone(atlenv *parent);
+void    atl_reset(void);
+#endif
 
 void P_create(void);
 void P_dodoes(void);
@@ -211,8 +390,13 @@ void heapover(void);
 void badpointer(void);
 void stakunder(void);
 void rstakunder(void);
+#ifdef FPSTACK
+void fstakover(void);
+void fstakunder(void);
+#endif
 
 void divzero(void);
+void longstring(void);
 void exword(dictword *wp);
 void notcomp(void);
 void pwalkback(void);
@@ -239,6 +423,11 @@ void trouble(char *kind);
 #define ATL_DIVZERO     -13	      // attempt to divide by zero
 #define ATL_APPLICATION -14	      // application primitive atl_error()
 #define ATL_BADINPUTFILE -15        // could not load file
+#define ATL_SUSPENDED   -16         // atl_exec budget used up; atl_resume continues
+#define ATL_BADIMAGE    -17         // image can't be saved, or doesn't fit this system
+#define ATL_FSTACKOVER  -18         // floating point stack overflow
+#define ATL_FSTACKUNDER -19         // floating point stack underflow
+#define ATL_LONGSTRING  -20         // string literal too long for a temporary string buffer
 
 // for alignment for known CPU types that require alignment
 //
@@ -280,6 +469,7 @@ void trouble(char *kind);
 
 // Stack items occupied by a dictionary word definition
 #define Dictwordl ((sizeof(dictword)+(sizeof(stackitem)-1))/sizeof(stackitem))
+#define Wordlistl ((sizeof(struct wordlist)+(sizeof(stackitem)-1))/sizeof(stackitem))
 
 // token types
 //
@@ -320,13 +510,18 @@ void trouble(char *kind);
 #   define Msh(n)
 #endif
 
+// Under STACKGUARD a guard page above each stack catches pushes off
+// its top in place of So.  Pops are still compared with the bottom.
 #ifdef NOMEMCHECK
 #   define Sl(x)
-#   define So(n)
 #else
 #   define Memerrs
 #   define Sl(x) if ((atl__env->stk-atl__env->stack)<(x)) {stakunder(); return Memerrs;}
+#endif
+#ifdef STACKCHECK
 #   define So(n) Mss(n) if ((atl__env->stk+(n))>atl__env->stkTop) {stakover(); return Memerrs;}
+#else
+#   define So(n)
 #endif
 
 // return stack access definitions
@@ -338,10 +533,13 @@ void trouble(char *kind);
 #define Rpush   *atl__env->rs++     // push return stack
 #ifdef NOMEMCHECK
 #   define Rsl(x)
-#   define Rso(n)
 #else
 #   define Rsl(x) if ((atl__env->rs-atl__env->rstack)<(x)) {rstakunder(); return Memerrs;}
+#endif
+#ifdef STACKCHECK
 #   define Rso(n) Msr(n) if ((atl__env->rs+(n))>atl__env->rsTop){rstakover(); return Memerrs;}
+#else
+#   define Rso(n)
 #endif
 
 // heap access definitions
@@ -363,14 +561,47 @@ void trouble(char *kind);
 // real number definitions (used only if REAL is configured)
 //
 #define Realsize (sizeof(atl_real)/sizeof(stackitem)) /* Stack cells / real */
-#define Realpop  atl__env->stk -= Realsize      /* Pop real from stack */
-#define Realpop2 atl__env->stk -= (2 * Realsize) /* Pop two reals from stack */
+
+// floating point stack access definitions (FPSTACK).  reals have a
+// stack of their own, of atl_real slots, so they are always aligned
+// and are used in place.
+//
+#ifdef FPSTACK
+#   define F0           atl__env->fstk[-1]          // top of floating stack
+#   define F1           atl__env->fstk[-2]          // next on floating stack
+#   define Fpop         atl__env->fstk--            // pop floating stack
+#   define Fpush        *atl__env->fstk++           // push floating stack
+#   ifdef MEMSTAT
+#       define Msf(n)   if ((atl__env->fstk+(n))>atl__env->fstkMaxExtent) atl__env->fstkMaxExtent = atl__env->fstk+(n);
+#   else
+#       define Msf(n)
+#   endif
+#   ifdef NOMEMCHECK
+#       define Fsl(x)
+#       define Fso(n)
+#   else
+#       define Fsl(x)   if ((atl__env->fstk-atl__env->fstack)<(x)) {fstakunder(); return Memerrs;}
+#       define Fso(n)   Msf(n) if ((atl__env->fstk+(n))>atl__env->fstkTop) {fstakover(); return Memerrs;}
+#   endif
+#   define Realsl(n)    Fsl(n)                      // n reals present
+#   define Realpop      Fpop                        // pop real from stack
+#   define Realpop2     atl__env->fstk -= 2         // pop two reals from stack
+#else
+#   define Realsl(n)    Sl((n) * Realsize)
+#   define Realpop      atl__env->stk -= Realsize   // pop real from stack
+#   define Realpop2     atl__env->stk -= (2 * Realsize) // pop two reals from stack
+#endif
 
 // TODO: alignment if stack isn't on a boundary. rather than let the CPU handle the
 //       mis-alignment in a slow way (or in a throw-an-exception way), use a memcpy
 //       to put the item in a properly aligned slot.
 //
-#ifndef ALIGNMENT
+#ifdef FPSTACK
+#   define REAL0        F0                          // first real on stack
+#   define REAL1        F1                          // second real on stack
+#   define SREAL0(x)    F0 = (x)
+#   define SREAL1(x)    F1 = (x)
+#elif !defined(ALIGNMENT)
 #   define REAL0        *((atl_real *) &S1)         // first real on stack
 #   define REAL1        *((atl_real *) &S3)         // second real on stack
 #   define REAL2        *((atl_real *) &S5)         // third real on stack
@@ -459,6 +690,22 @@ atlenv *atl__env = 0;
 #   include <math.h>
 #endif
 
+#ifdef SIMDSCAN
+#   include <emmintrin.h>
+#endif
+
+// Safe points, where we poll for a break and charge the budget of
+// atl_exec().  They are only where execution can loop back or nest, so
+// straight-line code runs without them but any loop or recursion stops
+// within one pass.  Each comes after ip has been moved on, so that ip
+// is where execution would resume.
+//
+#ifdef BREAK
+#   define Bpoll  if (atl__env->asyncBreakReceived || (atl__env->fuel > 0 && --atl__env->fuel == 0)) {if (safepoint()) return;}
+#else
+#   define Bpoll  if (atl__env->fuel > 0 && --atl__env->fuel == 0) {if (safepoint()) return;}
+#endif
+
 // Implicit functions (work for all numeric types).
 //
 #ifdef abs
@@ -502,9 +749,11 @@ static char *fopenmodes[] = {
 };
 #endif // FILEIO
 
-atlenv *atl__NewInterpreter(void) {
-    fprintf(stderr, "ATLast 1.2a (2014/06/19)\n");
-
+// newenv()
+//   allocates an interpreter and sets its defaults, quietly, as
+//   atl_clone needs.
+//
+static atlenv *newenv(void) {
     atlenv *e = malloc(sizeof(*e));
     if (!e) {
         return e;
@@ -512,11 +761,28 @@ atlenv *atl__NewInterpreter(void) {
 
     // assign default private values (TODO: allocate memory)
     e->asyncBreakReceived       = atlFalse;
+    e->instrumented             = atlFalse;
+    e->parkedIp                 = 0;
+    e->fuel                     = 0;
+    e->execNesting              = 0;
+    e->suspendedIp              = 0;
+    e->preparedName             = 0;
     e->currentNumberBase        = 10;
     e->createWord       = 0;
     e->currentWord      = 0;
     e->dict             = 0;
     e->dictFirstProtectedEntry  = 0;
+    e->forth.lhash              = 0;
+    e->forth.lmask              = 0;
+    e->forth.lcount             = 0;
+    e->forth.lnext              = 0;
+    e->current                  = &e->forth;
+    e->order[0]                 = &e->forth;
+    e->orderDepth               = 1;
+    e->wordlists                = 0;
+    e->names                    = 0;
+    e->nameAllocPtr             = 0;
+    e->dictPrimitives           = 0;
     e->evalStatus       = ATL_SNORM;
     e->heap             = 0;
     e->heapAllocPtr     = 0;
@@ -526,7 +792,14 @@ atlenv *atl__NewInterpreter(void) {
     e->idxCurrTempStringBuffer = 0;
     e->inputBuffer      = 0;
     e->ip               = 0;
+#ifdef NATIVECODE
+    e->jitArena         = 0;
+    e->jitPtr           = 0;
+    e->jitTop           = 0;
+#endif
     e->nextToken        = atl__ReadNextToken;
+    e->tokptr           = 0;
+    e->toklen           = 0;
     e->rstack           = 0;
     e->rs               = 0;
     e->rsBottom         = 0;
@@ -544,11 +817,33 @@ atlenv *atl__NewInterpreter(void) {
     e->s_xdo            = 0;
     e->s_xloop          = 0;
     e->s_xqdo           = 0;
+#ifdef SUPERINST
+    e->s_2dup           = 0;
+    e->s_atplus         = 0;
+    e->s_dupat          = 0;
+    e->s_iplus          = 0;
+    e->s_liteqqbranch   = 0;
+    e->s_litplus        = 0;
+    e->fuseMask         = (1L << FuseRules) - 1;
+    e->fuseProfiling    = atlFalse;
+    e->fuseHistory[0]   = 0;
+    e->fuseHistory[1]   = 0;
+    memset(e->fuseCounts, 0, sizeof(e->fuseCounts));
+#endif
+#ifdef STACKEFFECT
+    e->s_stackcheck     = 0;
+#endif
     e->stack            = 0;
     e->stk              = 0;
     e->stkBottom        = 0;
     e->stkMaxExtent     = 0;
     e->stkTop           = 0;
+#ifdef FPSTACK
+    e->fstack           = 0;
+    e->fstk             = 0;
+    e->fstkMaxExtent    = 0;
+    e->fstkTop          = 0;
+#endif
     e->strbuf           = 0;
     e->tokPendingCompile        = atlFalse;
     e->tokPendingDefine         = atlFalse;
@@ -558,22 +853,54 @@ atlenv *atl__NewInterpreter(void) {
     e->tokPendingTickMark       = atlFalse;
     e->walkback                 = 0;
     e->walkbackPointer          = 0;
+#ifdef STACKGUARD
+    e->guardCatch               = 0;
+#endif
+#ifdef CLONE
+    e->primTables               = 0;
+    e->primTableCount           = 0;
+    e->clone                    = 0;
+#endif
 
     // assign default public values
     e->allowRedefinition            = atlTruth;
+    e->cachePath                    = 0;
+    e->enableFusion                 = atlTruth;
+    e->enableJit                    = atlFalsity;
+    e->enableStackEffect            = atlTruth;
+    e->enableSubthread              = atlFalsity;
     e->enableTrace                  = atlFalsity;
     e->enableWalkback               = atlTruth;
+    e->execBudget                   = 0;
+#ifdef VMRESERVE
+    e->heapLength                   = 1L << 24;     /* Reserved, committed as used */
+#else
     e->heapLength                   = 1000;
+#endif
     e->isIgnoringComment            = atlFalsity;
+    e->jitLength                    = 262144;
     e->lengthTempStringBuffer       =  256;
     e->lineNumberLastLoadFailed     =    0;
     e->numberOfTempStringBuffers    =    4;
+#ifdef VMRESERVE
+    e->fstkLength                   = 1L << 20;
+    e->rsLength                     = 1L << 20;
+    e->stkLength                    = 1L << 20;
+#else
+    e->fstkLength                   =  100;
     e->rsLength                     =  100;
     e->stkLength                    =  100;
+#endif
 
     return e;
 }
 
+atlenv *atl__NewInterpreter(void) {
+    fprintf(stderr, "ATLast 1.2a (2014/06/19)\n");
+
+    return newenv();
+}
+
 // Break
 //   set the asyncBreakReceived (should reall be asymBreakRequested)
 //   flag in the state. this serves notice to the interpreter that
@@ -586,18 +913,88 @@ void atl__Break(void) {
     atl__env->asyncBreakReceived = atlTrue;		      /* Set break request */
 }
 
-// ReadFile(path, fileName)
+// Instrument
+//   choose between the two inner interpreter loops. the lean one
+//   runs words with nothing checked between them; the instrumented
+//   one traces and counts sequences for FUSEPROFILE. called
+//   whenever exword() is entered, which catches hosts that set
+//   enableTrace directly.
+//
+static void instrument(void) {
+    Boolean on = atlFalse;
+
+#ifdef TRACE
+    on = on || atl__env->enableTrace;
+#endif
+#ifdef SUPERINST
+    on = on || atl__env->fuseProfiling;
+#endif
+    atl__env->instrumented = on;
+}
+
+// Reinstrument
+//   called by the words that turn TRACE or FUSEPROFILE on or off.
+//   the lean loop doesn't look at the flag, so to get it to switch
+//   we park ip and clear it, which ends the lean loop as EXIT from
+//   the outermost word would. the loop, or compiled code in between
+//   that sees ip cleared as an abort, returns to exword(), which
+//   finds the parked ip and carries on in the instrumented loop.
+//
+static void reinstrument(void) {
+    instrument();
+    if (atl__env->instrumented && atl__env->ip != NULL) {
+        atl__env->parkedIp = atl__env->ip;
+        atl__env->ip = NULL;
+    }
+}
+
+// Unpark
+//   pick up an ip parked by reinstrument(). returns false if
+//   execution really ended.
+//
+static Boolean unpark(void) {
+    if (atl__env->parkedIp == NULL) {
+        return atlFalse;
+    }
+    atl__env->ip = atl__env->parkedIp;
+    atl__env->parkedIp = NULL;
+    return atlTrue;
+}
+
+// Safepoint
+//   called at a safe point when a break is pending or the budget of
+//   the running atl_exec() has run out. returns true if execution
+//   was stopped. a break aborts. running out of budget suspends,
+//   leaving ip and the return stack for atl_resume() to carry on
+//   from, unless C code such as EVALUATE sits between us and
+//   atl_exec(); then we look again at the next safe point.
+//
+static Boolean safepoint(void) {
+#ifdef BREAK
+    if (atl__env->asyncBreakReceived) {
+        trouble("Break signal");
+        atl__env->evalStatus = ATL_BREAK;
+        return atlTrue;
+    }
+#endif
+    if (atl__env->execNesting != 1) {
+        atl__env->fuel = 1;
+        return atlFalse;
+    }
+    atl__env->suspendedIp = atl__env->ip;
+    atl__env->ip = NULL;
+    atl__env->evalStatus = ATL_SUSPENDED;
+    return atlTrue;
+}
+
+// FindFile(path, fileName, statBuf)
 //   searches the path for the given file. if found, it returns
-//   a malloc'd character buffer containing the contents of
-//   the file. uses "fread", so it doesn't even pretend to
-//   understand the various end-of-line conventions.
+//   a malloc'd copy of its full name and fills in statBuf.
 //
-char *atl__ReadFile(const char **path, const char *fileName) {
+char *atl__FindFile(const char **path, const char *fileName, struct stat *statBuf) {
     int             idx;
     size_t      lenName = strlen(fileName);
     size_t      lenPath = 0;
-    struct stat statBuf;
-    char          *text = 0;
 
     // calculate minimum length of buffer for path + name
     //
@@ -612,54 +1009,132 @@ char *atl__ReadFile(const char **path, const char *fileName) {
     if (nameBuffer) {
         // search the path for the file name
         //
-        for (idx = 0; !text && path[idx]; idx++) {
+        for (idx = 0; path[idx]; idx++) {
             sprintf(nameBuffer, "%s%s", path[idx], fileName);
-
-            // if found, read it into the text buffer
-            //
             fprintf(stderr, ".read:\ttry %s\n", nameBuffer);
-            if (stat(nameBuffer, &statBuf) == 0) {
-                // allocate enough space for the file and the new line plus nil terminator
-                //
-                text = malloc(statBuf.st_size + 2);
-                if (text) {
-                    // set those two extra bytes to zero so that we don't forget to
-                    // do it later. they ensure that we end up nil-terminated.
-                    //
-                    text[statBuf.st_size    ] = 0;
-                    text[statBuf.st_size + 1] = 0;
-
-                    // only do the file read if it has data in it
-                    //
-                    if (statBuf.st_size > 0) {
-                        FILE *fp = fopen(nameBuffer, "r");
-                        if (!fp || fread(text, statBuf.st_size, 1, fp) != 1) {
-                            // delete text on any error
-                            //
-                            free(text);
-                            text = 0;
-                        }
-                        if (fp) {
-                            fclose(fp);
-                        }
-                    }
-                }
+            if (stat(nameBuffer, statBuf) == 0) {
+                return nameBuffer;
             }
         }
     }
 
     free(nameBuffer);
 
+    return 0;
+}
+
+// readtext(name, size)
+//   returns a malloc'd character buffer containing the size bytes
+//   of the named file, followed by two nil bytes. uses "fread", so
+//   it doesn't even pretend to understand the various end-of-line
+//   conventions.
+//
+static char *readtext(const char *name, size_t size) {
+    // allocate enough space for the file and the new line plus nil terminator
+    //
+    char *text = malloc(size + 2);
+    if (text) {
+        // set those two extra bytes to zero so that we don't forget to
+        // do it later. they ensure that we end up nil-terminated.
+        //
+        text[size    ] = 0;
+        text[size + 1] = 0;
+
+        // only do the file read if it has data in it
+        //
+        if (size > 0) {
+            FILE *fp = fopen(name, "r");
+            if (!fp || fread(text, size, 1, fp) != 1) {
+                // delete text on any error
+                //
+                free(text);
+                text = 0;
+            }
+            if (fp) {
+                fclose(fp);
+            }
+        }
+    }
+
+    return text;
+}
+
+// ReadFile(path, fileName)
+//   searches the path for the given file. if found, it returns
+//   a malloc'd character buffer containing the contents of
+//   the file.
+//
+char *atl__ReadFile(const char **path, const char *fileName) {
+    struct stat statBuf;
+    char         *text = 0;
+    char         *name = atl__FindFile(path, fileName, &statBuf);
+
+    if (name) {
+        text = readtext(name, statBuf.st_size);
+    }
+
+    free(name);
+
+    return text;
+}
+
+// mapfile(name, size, mapLength)
+//   maps the size bytes of the named file read-only and shared, so
+//   that every interpreter loading it uses the page cache's copy.
+//   the file is mapped over the start of an anonymous reservation at
+//   least a page longer, so the text is always followed by nil bytes.
+//   returns 0 if it can't be mapped, else the text, with the length
+//   to unmap in mapLength.
+//
+static char *mapfile(const char *name, size_t size, size_t *mapLength) {
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t len = (size / page + 1) * page;
+    int     fd = open(name, O_RDONLY);
+    char *text = 0;
+
+    if (fd >= 0) {
+        void *a = mmap(NULL, len, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (a != MAP_FAILED) {
+            if (mmap(a, size, PROT_READ, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED) {
+                text = a;
+                *mapLength = len;
+            } else {
+                munmap(a, len);
+            }
+        }
+        close(fd);
+    }
+
     return text;
 }
 
+// linecount(text, end)
+//   counts the line ends, CR, LF, CR LF or LF CR, between text and end.
+//
+static atl_int linecount(char *text, char *end) {
+    atl_int n = 0;
+
+    while (text < end) {
+        char c = *text++;
+        if (c == '\n' || c == '\r') {
+            n++;
+            if (text < end && *text == (c == '\n' ? '\r' : '\n')) {
+                text++;
+            }
+        }
+    }
+    return n;
+}
+
 // EvalText(text)
 //   evaluates all the text in a buffer as though it were typed in
-//   at the prompt. probably not what it should be doing.
+//   at the prompt. the text is tokenized where it lies and isn't
+//   written on, so it may be mapped read-only. the line of an error
+//   is found by counting the line ends before the point it was found.
 //
 int atl__EvalText(char *text) {
     int evalStatus = ATL_SNORM;
-    int lineNumber = 0;                             // will hold current line in text
+    atl_int lineNumber = 1;                         // line text starts on
 
     // save some state
     //
@@ -681,49 +1156,38 @@ int atl__EvalText(char *text) {
     //
     atl__env->ip = NULL;
 
-    // handle the eval line by line
+#ifdef PROLOGUE
+    // until the system is initialised, lines may be prologue statements,
+    // which atl_prologue() edits, so they're evaluated one at a time from
+    // a copy
     //
-    while (*text) {
-        lineNumber++;
-
-        // save the start of line since the eval function needs it
-        //
-        char *startOfLine = text;
-
-        // find end of the line
-        //
-        char *endOfLine = text;
-        while (*endOfLine && !(*endOfLine == '\n' || *endOfLine == '\r')) {
-            endOfLine++;
-        }
-
-        // we process line by line, so make the line separator a nul byte
-        // so that the eval function can see only one line at a time
-        //
-        if (*endOfLine == '\r') {
-            *(endOfLine++) = 0;
-            if (*endOfLine == '\n') {
-                *(endOfLine++) = 0;
-            }
-        } else if (*endOfLine == '\n') {
-            *(endOfLine++) = 0;
-            if (*endOfLine == '\r') {
-                *(endOfLine++) = 0;
-            }
-        }
-
-        // call function to process the input "pad"
-        //
-        int evalStatus;
-        if ((evalStatus = atl_eval(startOfLine)) != ATL_SNORM) {
-            atl__env->lineNumberLastLoadFailed = lineNumber; // save line number of error
+    while (atl__env->dict == NULL && *text) {
+        size_t len = strcspn(text, "\r\n");
+        char  *line = alloc((unsigned int) len + 1);
+
+        memcpy(line, text, len);
+        line[len] = 0;
+        evalStatus = atl_eval(line);
+        free(line);
+        if (evalStatus != ATL_SNORM) {
+            atl__env->lineNumberLastLoadFailed = lineNumber;
             atl_unwind(&mk);
             break;
         }
-
-        // move our text pointer to the beginning of the next line
-        // to restart the cycle for that line
-        text = endOfLine;
+        text += len;
+        if (*text) {
+            char c = *text++;
+            if (*text == (c == '\n' ? '\r' : '\n')) {
+                text++;
+            }
+            lineNumber++;
+        }
+    }
+    if (evalStatus == ATL_SNORM)
+#endif // PROLOGUE
+    if ((evalStatus = atl_eval(text)) != ATL_SNORM) {
+        atl__env->lineNumberLastLoadFailed = lineNumber + linecount(text, atl__env->inputBuffer);
+        atl_unwind(&mk);
     }
 
     // If there were no other errors, check for a runaway comment.
@@ -747,23 +1211,52 @@ int atl__EvalText(char *text) {
     return evalStatus;
 }
 
+#ifdef LOADCACHE
+static int cacheeval(char *text, size_t n);
+#endif
+#ifdef IMAGE
+static void imagemark(void);
+#endif
+
 // LoadFile(path, file)
-//   calls ReadFile to load a file buffer, then calls EvalText
-//   to evaluate the contents.
+//   maps the file, or failing that reads it into a buffer, then
+//   calls EvalText to evaluate the contents (through the cache of
+//   compiled code, if LOADCACHE is configured and cachePath set).
 //
 int atl__LoadFile(const char **path, const char *fileName) {
-    char *text = atl__ReadFile(path, fileName);
+    struct stat statBuf;
+    size_t    mapLength = 0;
+    char         *text = 0;
+    char         *name = atl__FindFile(path, fileName, &statBuf);
+
+    if (name) {
+        if (S_ISREG(statBuf.st_mode) && statBuf.st_size > 0) {
+            text = mapfile(name, statBuf.st_size, &mapLength);
+        }
+        if (!text) {
+            text = readtext(name, statBuf.st_size);
+        }
+        free(name);
+    }
     if (!text) {
         perror(fileName);
         return ATL_BADINPUTFILE;
     }
 
+#ifdef LOADCACHE
+    int statusInclude = atl__env->cachePath != NULL ? cacheeval(text, statBuf.st_size) : atl__EvalText(text);
+#else
     int statusInclude = atl__EvalText(text);
+#endif
     if (statusInclude != ATL_SNORM) {
         fprintf(stderr, "\nerror:\t%d in include file %s\n", statusInclude, fileName);
     }
 
-    free(text);
+    if (mapLength) {
+        munmap(text, mapLength);
+    } else {
+        free(text);
+    }
 
     return statusInclude;
 }
@@ -782,6 +1275,153 @@ char *alloc(unsigned int size) {
     return cp;
 }
 
+// reserve(size)
+// reserve size bytes of address space for the heap or a stack.
+// the system commits a page of it only when the page is first
+// touched, so a reservation far larger than needed costs only what
+// is used, and it never moves, so nothing pointing into it has to.
+//
+#ifndef MAP_NORESERVE
+#   define MAP_NORESERVE 0
+#endif
+#ifdef VMRESERVE
+static char *reserve(size_t size) {
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "\n\nOut of address space!  %lu bytes requested.\n", (unsigned long) size);
+        abort();
+    }
+    return (char *) p;
+}
+#   define Reserve(n) reserve(n)
+#   define Unreserve(p, n) munmap((p), (n))
+#else
+#   define Reserve(n) alloc(n)
+#   define Unreserve(p, n) free(p)
+#endif
+
+// guarded(length, spare)
+// map a stack of length cells, with spare cells below its bottom,
+// between guard pages that can't be touched.  the length is rounded
+// up to fill whole pages, so the top meets the guard above it.  a
+// push past the top faults in that guard, and guardfault() turns it
+// into the error So would have reported.  pops are still compared
+// with the bottom; the guard below only stops a primitive that peeks
+// under it from reading another mapping.  returns the bottom of the
+// stack.
+//
+#ifdef STACKGUARD
+#define Guardpages  16                  // pages in each guard
+
+static size_t guardPage;                // page size
+static struct sigaction guardPrevious[2]; // SIGSEGV and SIGBUS actions before ours
+
+static void *guarded(atl_int *length, int spare) {
+    size_t size, guard;
+    char *p;
+
+    guardPage = (size_t) sysconf(_SC_PAGESIZE);
+    guard = Guardpages * guardPage;
+    size = ((((size_t) *length + spare) * sizeof(stackitem)) + guardPage - 1) & ~(guardPage - 1);
+    p = mmap(NULL, size + 2 * guard, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED || mprotect(p + guard, size, PROT_READ | PROT_WRITE) != 0) {
+        fprintf(stderr, "\n\nOut of address space!  %lu bytes requested.\n", (unsigned long) (size + 2 * guard));
+        abort();
+    }
+    *length = (atl_int) (size / sizeof(stackitem)) - spare;
+    return p + guard + spare * sizeof(stackitem);
+}
+
+// guardside(a, bottom, top)
+// -1 if a is in the guard below the stack from bottom to top, 1 if
+// in the guard above it, 0 if in neither.
+//
+static int guardside(char *a, void *bottom, void *top) {
+    char *lo = (char *) (((size_t) bottom) & ~(guardPage - 1));
+
+    if (a < lo && a >= lo - Guardpages * guardPage) {
+        return -1;
+    }
+    if (a >= (char *) top && a < ((char *) top) + Guardpages * guardPage) {
+        return 1;
+    }
+    return 0;
+}
+
+// guardfault(sig, info, context)
+// a fault in a guard page of the running interpreter unwinds to its
+// innermost catch, with the error that is to be reported.  any other
+// fault is put back to the action we replaced, and happens again
+// under it when we return.
+//
+static void guardfault(int sig, siginfo_t *info, void *context) {
+    char *a = (char *) info->si_addr;
+    int es = 0, side;
+
+    (void) context;
+    if (atl__env != NULL && atl__env->guardCatch != NULL) {
+        if ((side = guardside(a, atl__env->stack, atl__env->stkTop)) != 0) {
+            es = (side < 0) ? ATL_STACKUNDER : ATL_STACKOVER;
+        } else if ((side = guardside(a, atl__env->rstack, atl__env->rsTop)) != 0) {
+            es = (side < 0) ? ATL_RSTACKUNDER : ATL_RSTACKOVER;
+#ifdef WALKBACK
+        } else if (guardside(a, atl__env->walkback, atl__env->walkback + atl__env->rsLength) > 0) {
+            es = ATL_RSTACKOVER;        /* Keeps pace with the return stack */
+#endif
+        }
+    }
+    if (es == 0) {
+        sigaction(sig, &guardPrevious[sig == SIGBUS], NULL);
+        return;
+    }
+    siglongjmp(atl__env->guardCatch->jump, es);
+}
+
+// guardinstall()
+// install guardfault for the faults a guard page raises.  the catch
+// doesn't save the signal mask, so the signal is left unblocked while
+// the handler runs; it never returns from a guard fault.
+//
+static void guardinstall(void) {
+    static Boolean installed = atlFalse;
+    struct sigaction sa;
+
+    if (!installed) {
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_sigaction = guardfault;
+        sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGSEGV, &sa, &guardPrevious[0]);
+        sigaction(SIGBUS, &sa, &guardPrevious[1]);
+        installed = atlTrue;
+    }
+}
+
+// guardmax(bottom, top)
+// the end of the last page of a guarded stack that has been touched.
+// a page is made resident when it is first used, so that bounds how
+// deep the stack has been, to the page, without a check on each push.
+//
+static char *guardmax(void *bottom, void *top) {
+    char *lo = (char *) (((size_t) bottom) & ~(guardPage - 1));
+    size_t i, n = (size_t) (((char *) top) - lo) / guardPage;
+    unsigned char *v = (unsigned char *) alloc((unsigned int) n);
+    char *max = (char *) bottom;
+
+    if (mincore(lo, n * guardPage, (void *) v) == 0) {
+        for (i = n; i > 0; i--) {
+            if (v[i - 1] & 1) {
+                max = lo + i * guardPage;
+                break;
+            }
+        }
+    }
+    free(v);
+    return max;
+}
+#endif /* STACKGUARD */
+
 // ucase(string)
 // force letters in c-string to upper case
 // modifies input
@@ -795,133 +1435,317 @@ void ucase(char *c) {
     }
 }
 
-// ReadNextToken(pointerToString)
-// scan a token and return its type
-//
-int atl__ReadNextToken(char **cp) {
-    char *sp = *cp;
+#ifdef SIMDSCAN
+/*  Source scanning, 16 characters at a time.  SKIPBLANKS returns the
+    first character at or after sp that isn't white space, and SCANFOR
+    the first that is c or EOS.  The loads are aligned, so they never
+    cross into a page the string doesn't reach, but they do read past
+    its end within the last 16 bytes; AddressSanitizer is told not to
+    mind.  Tokens are mostly short, so they are still copied a byte at
+    a time, and a single blank is skipped without going to the vector
+    unit.  */
 
-    while (atlTrue) {
-        char *tp = atl__env->tokbuf;
-        int tl = 0;
-        Boolean istring = atlFalse, rstring = atlFalse;
+#define Simdscan __attribute__((no_sanitize_address))
 
-        // if the prior token was a comment, keep skipping
-        // until we encounter the end of the comment
-        // (or end of input)
-        //
-        if (atl__env->isIgnoringComment) {
-            while (*sp != ')') {
-                if (*sp == EOS) {
-                    *cp = sp;
-                    return TokNull;
-                }
-                sp++;
-            }
-            sp++;
-            atl__env->isIgnoringComment = atlFalsity;
-        }
+// Bit i set if byte i is white space, as isspace() has it: blank or
+// \t \n \v \f \r (9 to 13).
+static inline unsigned int spacebits(__m128i v) {
+    __m128i c = _mm_sub_epi8(v, _mm_set1_epi8(9));
 
-        // skip leading blanks
-        while (isspace(*sp)) {
-            sp++;
-        }
+    return (unsigned int) _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                                                         _mm_cmpeq_epi8(_mm_min_epu8(c, _mm_set1_epi8(4)), c)));
+}
 
-        // look for a string starting with double quotes
-        //
-        if (*sp == '"') {
-            char quote = *(sp++);
-            while (atlTrue) {
-                char c = *sp++;
+Simdscan static char *skipblanks(char *sp) {
+    unsigned int off;
+    unsigned int m;
+    char *p;
+
+    if (!isspace(sp[0])) {
+        return sp;
+    }
+    if (!isspace(sp[1])) {
+        return sp + 1;
+    }
+    off = (unsigned int) ((size_t) sp & 15);
+    p = sp - off;
+    m = (~spacebits(_mm_load_si128((__m128i *) p)) & 0xFFFF) >> off << off;
+    while (m == 0) {
+        p += 16;
+        m = ~spacebits(_mm_load_si128((__m128i *) p)) & 0xFFFF;
+    }
+    return p + __builtin_ctz(m);
+}
+
+Simdscan static char *scanfor(char *sp, char c) {
+    unsigned int off = (unsigned int) ((size_t) sp & 15);
+    char *p = sp - off;
+    __m128i cv = _mm_set1_epi8(c), z = _mm_setzero_si128();
+    __m128i v = _mm_load_si128((__m128i *) p);
+    unsigned int m = ((unsigned int) _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, cv), _mm_cmpeq_epi8(v, z)))) >> off << off;
+
+    while (m == 0) {
+        p += 16;
+        v = _mm_load_si128((__m128i *) p);
+        m = (unsigned int) _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, cv), _mm_cmpeq_epi8(v, z)));
+    }
+    return p + __builtin_ctz(m);
+}
+#endif /* SIMDSCAN */
+
+/*  PARSEINT  --  Parse a token of n characters as an integer in the
+    current base, leaving it in *v.  As before, 0x starts a hex number
+    in any base and, in decimal, a leading 0 an octal one.  The
+    magnitude must fit in a cell (a negative one, in a signed cell).
+    Decimal numbers too short to overflow (18 digits in a 64 bit cell)
+    take a short cut.  */
+
+static Boolean parseint(char *s, size_t n, long *v) {
+    char *e = s + n, *p;
+    Boolean neg = (*s == '-');
+    unsigned long base = (unsigned long) atl__env->currentNumberBase, u = 0, d;
+
+    if (neg) {
+        s++;
+    }
+    if (e - s > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+        base = 16;
+        s += 2;
+    } else if (e - s > 1 && s[0] == '0' && base == 10) {
+        base = 8;
+        s++;
+    }
+    if (base == 10 && e > s && e - s <= (sizeof(unsigned long) == 8 ? 18 : 9)) {
+        for (p = s; p < e && (unsigned) (*p - '0') < 10; p++) {
+            u = u * 10 + (unsigned) (*p - '0');
+        }
+        if (p == e) {
+            *v = neg ? -(long) u : (long) u;
+            return atlTrue;
+        }
+        u = 0;
+    }
+    if (s == e || base < 2 || base > 36) {
+        return atlFalse;
+    }
+    for (p = s; p < e; p++) {
+        if (isdigit(*p)) {
+            d = (unsigned) (*p - '0');
+        } else if (isalpha(*p)) {
+            d = (unsigned) (toupper(*p) - 'A' + 10);
+        } else {
+            return atlFalse;
+        }
+        if (d >= base || u > (ULONG_MAX - d) / base) {
+            return atlFalse;      /* Not a digit, or overflow */
+        }
+        u = u * base + d;
+    }
+    if (neg && u > (unsigned long) LONG_MAX + 1) {
+        return atlFalse;
+    }
+    *v = neg ? (long) (0 - u) : (long) u;
+    return atlTrue;
+}
+
+#ifdef REAL
+/*  PARSEREAL  --  Parse a token of n characters as a decimal real
+    number, which must have a decimal point or an exponent, leaving it
+    in *r.  When the digits fit in 53 bits and the power of ten is one
+    that a double holds exactly, one multiply or divide gives the
+    correctly rounded result; anything else goes to strtod().  */
+
+static Boolean parsereal(char *s, size_t n, atl_real *r) {
+    static const double pow10[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    char *p = s, *e = s + n;
+    unsigned long long m = 0;
+    int digits = 0, scale = 0, x = 0;
+    Boolean neg = atlFalse, xneg = atlFalse, frac = atlFalse;
+
+    if (p < e && *p == '-') {
+        neg = atlTrue;
+        p++;
+    }
+    for (; p < e && (unsigned) (*p - '0') < 10; p++, digits++) {
+        m = m * 10 + (unsigned) (*p - '0');
+    }
+    if (p < e && *p == '.') {
+        frac = atlTrue;
+        for (p++; p < e && (unsigned) (*p - '0') < 10; p++, digits++, scale--) {
+            m = m * 10 + (unsigned) (*p - '0');
+        }
+    }
+    if (digits == 0) {
+        return atlFalse;
+    }
+    if (p < e && (*p == 'e' || *p == 'E')) {
+        frac = atlTrue;
+        p++;
+        if (p < e && (*p == '-' || *p == '+')) {
+            xneg = (*p++ == '-');
+        }
+        if (p == e || (unsigned) (*p - '0') >= 10) {
+            return atlFalse;
+        }
+        for (; p < e && (unsigned) (*p - '0') < 10; p++) {
+            if (x < 10000) {
+                x = x * 10 + (*p - '0');
+            }
+        }
+    }
+    if (p != e || !frac) {
+        return atlFalse;
+    }
+    scale += xneg ? -x : x;
+    if (digits <= 19 && m <= (1ULL << 53) && scale >= -22 && scale <= 22) {
+        *r = scale < 0 ? (double) m / pow10[-scale] : (double) m * pow10[scale];
+    } else {
+        char *t = alloc((unsigned int) n + 1);   /* strtod() wants it terminated */
+
+        memcpy(t, s, n);
+        t[n] = EOS;
+        *r = strtod(t, NULL);
+        free(t);
+        return atlTrue;
+    }
+    if (neg) {
+        *r = -*r;
+    }
+    return atlTrue;
+}
+#endif /* REAL */
+
+/*  STRDECODE  --  Copy the n characters of a string token to d,
+    replacing its escapes, and terminate it.  At most max characters
+    are kept.  Returns the length of the whole string, which is more
+    than max if it was cut.  */
+
+static size_t strdecode(char *d, char *s, size_t n, size_t max) {
+    char *e = s + n;
+    size_t l = 0;
+
+    while (s < e) {
+        char c = *s++;
 
-                if (c == quote) {
-                    sp++;
-                    *tp++ = EOS;
+        if (c == '\\' && s < e) {
+            switch (c = *s++) {
+                case 'b':
+                    c = '\b';
                     break;
-                } else if (c == EOS) {
-                    rstring = atlTrue;
-                    *tp++ = EOS;
+                case 'n':
+                    c = '\n';
+                    break;
+                case 'r':
+                    c = '\r';
+                    break;
+                case 't':
+                    c = '\t';
+                    break;
+                default:
                     break;
-                } else if (c == '\\') {
-                    c = *sp++;
-                    if (c == EOS) {
-                        rstring = atlTrue;
-                        break;
-                    }
-                    switch (c) {
-                        case 'b':
-                            c = '\b';
-                            break;
-                        case 'n':
-                            c = '\n';
-                            break;
-                        case 'r':
-                            c = '\r';
-                            break;
-                        case 't':
-                            c = '\t';
-                            break;
-                        default:
-                            break;
-                    }
-                }
-                if (tl < (sizeof(atl__env->tokbuf)) - 1) {
-                    *tp++ = c;
-                    tl++;
-                } else {
-                    rstring = atlTrue;
-                }
             }
-            istring = atlTrue;
-        } else {
+        }
+        if (l < max) {
+            d[l] = c;
+        }
+        l++;
+    }
+    d[l < max ? l : max] = EOS;
+    return l;
+}
 
-            /* Scan the next raw token */
+// ReadNextToken(pointerToString)
+// scan a token and return its type.  The token is left where it
+// lies in the input, as atl__env->tokptr and toklen; for a string,
+// that's what is between the quotes, escapes and all (see strdecode).
+// The input may run over many lines; strings and \ comments end
+// with the line.
+//
+#define Endline(c)  ((c) == EOS || (c) == '\n' || (c) == '\r')
 
-            while (atlTrue) {
-                char c = *sp++;
+int atl__ReadNextToken(char **cp) {
+    char *sp = *cp, *ep;
 
-                if (c == EOS || isspace(c)) {
-                    *tp++ = EOS;
-                    break;
-                }
-                if (tl < (sizeof(atl__env->tokbuf)) - 1) {
-                    *tp++ = c;
-                    tl++;
+    while (atlTrue) {
+
+        // if the prior token was a comment, keep skipping
+        // until we encounter the end of the comment
+        // (or end of input)
+        //
+        if (atl__env->isIgnoringComment) {
+#ifdef SIMDSCAN
+            sp = scanfor(sp, ')');
+#endif
+            while (*sp != ')') {
+                if (*sp == EOS) {
+                    *cp = sp;
+                    return TokNull;
                 }
+                sp++;
             }
+            sp++;
+            atl__env->isIgnoringComment = atlFalsity;
+        }
+
+        // skip leading blanks
+#ifdef SIMDSCAN
+        sp = skipblanks(sp);
+#endif
+        while (isspace(*sp)) {
+            sp++;
         }
-        *cp = --sp;			  /* Store end of scan pointer */
 
-        if (istring) {
-            if (rstring) {
+        // look for a string starting with double quotes
+        //
+        if (*sp == '"') {
+            for (ep = ++sp; *ep != '"'; ep++) {
+                if (Endline(*ep) || (*ep == '\\' && (++ep, Endline(*ep)))) {
+                    atl__env->tokptr = sp;
+                    atl__env->toklen = ep - sp;
 #ifdef MEMMESSAGE
-                fprintf(stderr, "\nrunaway string: %s\n", atl__env->tokbuf);
+                    fprintf(stderr, "\nrunaway string: %.*s\n", (int) (ep - sp), sp);
 #endif
-                atl__env->evalStatus = ATL_RUNSTRING;
-                return TokNull;
+                    *cp = ep;
+                    atl__env->evalStatus = ATL_RUNSTRING;
+                    return TokNull;
+                }
             }
+            atl__env->tokptr = sp;
+            atl__env->toklen = ep - sp;
+            *cp = ep + 1;
             return TokString;
         }
 
-        if (atl__env->tokbuf[0] == EOS) {
+        /* Scan the next raw token */
+
+        for (ep = sp; *ep != EOS && !isspace(*ep); ep++) {
+        }
+        *cp = ep;			  /* Store end of scan pointer */
+        if (ep == sp) {
             return TokNull;
         }
+        atl__env->tokptr = sp;
+        atl__env->toklen = ep - sp;
 
         /* See if token is a comment to end of line character.	If so, discard
-         the rest of the line and return null for this token request. */
+         the rest of the line and carry on from there. */
 
-        if (strcmp(atl__env->tokbuf, "\\") == 0) {
-            while (*sp != EOS) {
-                sp++;
-            }
-            *cp = sp;
-            return TokNull;
+        if (ep - sp == 1 && *sp == '\\') {
+            sp = ep + strcspn(ep, "\r\n");
+            continue;
         }
 
         /* See if this token is a comment open delimiter.  If so, set to
          ignore all characters until the matching comment close delimiter. */
 
-        if (strcmp(atl__env->tokbuf, "(") == 0) {
+        if (ep - sp == 1 && *sp == '(') {
+            sp = ep;
+#ifdef SIMDSCAN
+            sp = scanfor(sp, ')');
+#endif
             while (*sp && *sp != ')') {
                 sp++;
             }
@@ -934,24 +1758,16 @@ int atl__ReadNextToken(char **cp) {
             return TokNull;
         }
 
-        /* See if the token is a number. */
+        /* See if the token is a number.  One that starts with a letter,
+         as it may in hex, is taken for a word; atl_eval() parses it
+         if no word has that name. */
 
-        if (isdigit(atl__env->tokbuf[0]) || (atl__env->tokbuf[0] == '-' && isdigit(atl__env->tokbuf[1]))) {
-            char tc;
-            char *tcp;
-
-#ifdef USE_SSCANF
-            if (sscanf(atl__env->tokbuf, "%li%c", &atl__env->tokint, &tc) == 1) {
-                return TokInt;
-            }
-#else
-    	    atl__env->tokint = strtoul(atl__env->tokbuf, &tcp, 0);
-            if (*tcp == 0) {
+        if (isdigit(sp[0]) || (sp[0] == '-' && ep - sp > 1 && isdigit(sp[1]))) {
+            if (parseint(sp, ep - sp, &atl__env->tokint)) {
                 return TokInt;
             }
-#endif
 #ifdef REAL
-            if (sscanf(atl__env->tokbuf, "%lf%c", &atl__env->tokreal, &tc) == 1) {
+            if (atl__env->currentNumberBase == 10 && parsereal(sp, ep - sp, &atl__env->tokreal)) {
                 return TokReal;
             }
 #endif
@@ -960,25 +1776,284 @@ int atl__ReadNextToken(char **cp) {
     }
 }
 
-/*  LOOKUP  --	Look up token in the dictionary.  */
+/*  Word names.  Each word's name is interned once, upper case, in a
+    struct dname in the name arena, along with its length and hash.
+    Every word in dict is also in the hash bucket for its name in its
+    wordlist.  Words go in at the head of their bucket, and since they
+    leave dict newest first (FORGET and atl_unwind), they also leave
+    from the head, so each bucket keeps its names in dict order and the
+    first match is still the newest definition.  */
 
-static dictword *lookup(char *tkname) {
-    dictword *dw = atl__env->dict;
+#define Dicthash0   1024              // initial number of hash buckets, FORTH-WORDLIST
+#define Wordhash0   16                // initial number of hash buckets, others
+#define Namechunk   16384             // name arena chunk size
+#define Dname(np)   ((struct dname *) ((np) - offsetof(struct dname, nflags)))
+#define Namesize(n) ((offsetof(struct dname, nname) + (n) + 1 + (sizeof(char *) - 1)) & ~(sizeof(char *) - 1))
+#define Namemax     255               // longest name kept
+#define Upper(c)    ((char) toupper((unsigned char) (c)))
 
-    ucase(tkname);		      /* Force name to upper case */
-    while (dw != NULL) {
-        if (!(dw->wname[0] & WORDHIDDEN) &&
-            (strcmp(dw->wname + 1, tkname) == 0)) {
+/*  NAMEHASH  --  Hash a name of n characters (FNV-1a), as if it were
+    upper case.  Names are kept upper case, but a token is looked up
+    where it lies in the input, so it's folded as it's read instead.  */
+
+static unsigned int namehash(char *name, size_t n) {
+    unsigned int h = 2166136261U;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        h = (h ^ (unsigned char) Upper(name[i])) * 16777619U;
+    }
+    return h;
+}
+
+/*  NAMEFILL  --  Fill in the struct dname at dn from name, which has
+    already been cut to n characters, for the current wordlist.  */
+
+static void namefill(struct dname *dn, char *name, size_t n, char flags) {
+    size_t i;
+
+    dn->nnext = NULL;
+    dn->nword = NULL;
+    dn->nlist = atl__env->current;
+    dn->nheap = 0;
+    dn->nflags = flags;
+    for (i = 0; i < n; i++) {
+        dn->nname[i] = Upper(name[i]);
+    }
+    dn->nname[n] = EOS;
+    dn->nhash = namehash(dn->nname, n);
+    dn->nlen = (unsigned char) n;
+}
+
+/*  INTERN  --  Allocate a struct dname for the n characters of name in
+    the name arena, with the flags given, and return its wname.  */
+
+static char *intern(char *name, size_t n, char flags) {
+    size_t size;
+    struct dname *dn;
+
+    if (n > Namemax) {
+        n = Namemax;
+    }
+    size = Namesize(n);
+    if (atl__env->names == NULL || atl__env->nameAllocPtr + size > atl__env->names->top) {
+        size_t cs = sizeof(struct namechunk) + size > Namechunk ? sizeof(struct namechunk) + size : Namechunk;
+        struct namechunk *nc = (struct namechunk *) alloc((unsigned int) cs);
+
+        nc->prev = atl__env->names;
+        nc->top = ((char *) nc) + cs;
+        atl__env->names = nc;
+        atl__env->nameAllocPtr = (char *) (nc + 1);
+    }
+    dn = (struct dname *) atl__env->nameAllocPtr;
+    atl__env->nameAllocPtr += size;
+    namefill(dn, name, n, flags);
+    return &dn->nflags;
+}
+
+/*  NAMEUNWIND  --  Cut the name arena back to p, a position it held
+    earlier, freeing any chunks begun since.  Names leave the arena
+    only this way, all at once, when FORGET or atl_unwind drops the
+    words that own them.  A position no longer in the arena (it was
+    cut back below it already) is ignored.  */
+
+static void nameunwind(char *p) {
+    struct namechunk *nc;
+
+    for (nc = atl__env->names; nc != NULL; nc = nc->prev) {
+        if (p >= (char *) (nc + 1) && p <= nc->top) {
+            break;
+        }
+    }
+    if (nc == NULL || (nc == atl__env->names && p > atl__env->nameAllocPtr)) {
+        return;
+    }
+    while (atl__env->names != nc) {
+        struct namechunk *top = atl__env->names;
+
+        atl__env->names = top->prev;
+        free(top);
+    }
+    atl__env->nameAllocPtr = p;
+}
+
+/*  DICTREHASH  --  Rebuild the buckets of wordlist wl from dict, with
+    n of them.  Words are linked in oldest first so that the newest
+    ends up at the head of its bucket.  */
+
+static void dictrehash(struct wordlist *wl, unsigned long n) {
+    dictword *dw, **words;
+    long i, count = 0;
+
+    for (dw = atl__env->dict; dw != NULL; dw = dw->wnext) {
+        count++;
+    }
+    words = (dictword **) alloc((unsigned int) ((count + 1) * sizeof(dictword *)));
+    for (i = 0, dw = atl__env->dict; dw != NULL; dw = dw->wnext) {
+        words[i++] = dw;
+    }
+    if (wl->lhash != NULL) {
+        free(wl->lhash);
+    }
+    wl->lhash = (struct dname **) alloc((unsigned int) (n * sizeof(struct dname *)));
+    memset(wl->lhash, 0, n * sizeof(struct dname *));
+    wl->lmask = n - 1;
+    wl->lcount = 0;
+    while (i-- > 0) {
+        dw = words[i];
+        if (dw->wname != NULL && Dname(dw->wname)->nlist == wl) {
+            struct dname *dn = Dname(dw->wname);
+            struct dname **b = &wl->lhash[dn->nhash & wl->lmask];
+
+            dn->nword = dw;
+            dn->nnext = *b;
+            *b = dn;
+            wl->lcount++;
+        }
+    }
+    free(words);
+}
+
+/*  DICTHASH  --  Link dw, just put at the head of dict, into its
+    bucket in its wordlist.  The buckets are doubled when they average
+    two words.  */
+
+static void dicthash(dictword *dw) {
+    struct wordlist *wl;
+    struct dname *dn, **b;
+
+    if (dw->wname == NULL) {
+        return;
+    }
+    dn = Dname(dw->wname);
+    wl = dn->nlist;
+    if (wl->lhash == NULL || wl->lcount >= 2 * (long) (wl->lmask + 1)) {
+        dictrehash(wl, wl->lhash != NULL ? 2 * (wl->lmask + 1) : (wl == &atl__env->forth ? Dicthash0 : Wordhash0));
+        return;                       // dw is in dict, so it's linked now
+    }
+    b = &wl->lhash[dn->nhash & wl->lmask];
+    dn->nword = dw;
+    dn->nnext = *b;
+    *b = dn;
+    wl->lcount++;
+}
+
+/*  DICTUNHASH  --  Unlink dw, about to leave dict, from its bucket.
+    It's normally at the head.  A name in the arena stays put until
+    the arena is unwound; one renamed by S>NAME! is freed here.  */
+
+static void dictunhash(dictword *dw) {
+    struct wordlist *wl;
+    struct dname *dn, **b;
+
+    if (dw->wname == NULL) {
+        return;
+    }
+    dn = Dname(dw->wname);
+    wl = dn->nlist;
+    if (wl->lhash != NULL) {
+        for (b = &wl->lhash[dn->nhash & wl->lmask]; *b != NULL; b = &(*b)->nnext) {
+            if (*b == dn) {
+                *b = dn->nnext;
+                wl->lcount--;
+                break;
+            }
+        }
+    }
+    if (dn->nheap) {
+        free(dn);
+    }
+}
+
+/*  NAMEMATCH  --  Test whether the n characters of name, in any case,
+    are the upper case name un.  */
+
+static Boolean namematch(char *un, char *name, size_t n) {
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        if (un[i] != Upper(name[i])) {
+            return atlFalse;
+        }
+    }
+    return atlTrue;
+}
+
+/*  WLSEARCH  --  Look up a name of len characters, hashed, in one
+    wordlist.  LINEARLOOKUP walks all of dict instead, as lookups did
+    before the hash index, to compare the two.  */
+
+static dictword *wlsearch(struct wordlist *wl, char *tkname, unsigned int h, size_t len) {
+    struct dname *dn;
+#ifdef LINEARLOOKUP
+    dictword *dw;
+
+    for (dw = atl__env->dict; dw != NULL; dw = dw->wnext) {
+        if (dw->wname == NULL || (dn = Dname(dw->wname))->nlist != wl) {
+            continue;
+        }
+#else
+    if (wl->lhash == NULL) {
+        return NULL;
+    }
+    for (dn = wl->lhash[h & wl->lmask]; dn != NULL; dn = dn->nnext) {
+#endif
+        if (dn->nhash == h && dn->nlen == len && !(dn->nflags & WORDHIDDEN) &&
+            namematch(dn->nname, tkname, len)) {
 #ifdef WORDSUSED
-            *(dw->wname) |= WORDUSED; /* Mark this word used */
+            dn->nflags |= WORDUSED;   /* Mark this word used */
 #endif
-            break;
+            return dn->nword;
         }
-        dw = dw->wnext;
+    }
+    return NULL;
+}
+
+/*  LOOKUP  --	Look up a name of len characters in the wordlists of
+    the search order.  It's taken as it stands, in any case; a token
+    needn't be copied out of the input.  */
+
+static dictword *lookup(char *tkname, size_t len) {
+    dictword *dw = NULL;
+    unsigned int h;
+    int i;
+
+    if (len > Namemax) {
+        len = Namemax;                /* As intern() cuts it */
+    }
+    h = namehash(tkname, len);
+
+    for (i = 0; dw == NULL && i < atl__env->orderDepth; i++) {
+        dw = wlsearch(atl__env->order[i], tkname, h, len);
     }
     return dw;
 }
 
+/*  WLFORGET  --  Drop the wordlists made by WORDLIST that the heap has
+    been cut back past, taking them out of the search order.  Their
+    words are gone already, having been defined after them.  */
+
+static void wlforget(void) {
+    while (atl__env->wordlists != NULL && (stackitem *) atl__env->wordlists >= atl__env->heapAllocPtr) {
+        struct wordlist *wl = atl__env->wordlists;
+        int i, j;
+
+        for (i = j = 0; i < atl__env->orderDepth; i++) {
+            if (atl__env->order[i] != wl) {
+                atl__env->order[j++] = atl__env->order[i];
+            }
+        }
+        atl__env->orderDepth = j;
+        if (atl__env->current == wl) {
+            atl__env->current = &atl__env->forth;
+        }
+        if (wl->lhash != NULL) {
+            free(wl->lhash);
+        }
+        atl__env->wordlists = wl->lnext;
+    }
+}
+
 /* Gag me with a spoon!  Does no compiler but Turbo support #if defined(x) || defined(y) ?? */
 #ifdef EXPORT
 #   define FgetspNeeded
@@ -1033,6 +2108,17 @@ char *atl_fgetsp(char *s, int n, FILE *stream) {
 /*  ATL_MEMSTAT  --  Print memory usage summary.  */
 
 void atl_memstat(void) {
+#ifdef STACKGUARD
+    stackitem *smax = (stackitem *) guardmax(atl__env->stack, atl__env->stkTop);
+    dictword ***rmax = (dictword ***) guardmax(atl__env->rstack, atl__env->rsTop);
+
+    if (smax > atl__env->stkMaxExtent) {
+        atl__env->stkMaxExtent = smax;
+    }
+    if (rmax > atl__env->rsMaxExtent) {
+        atl__env->rsMaxExtent = rmax;
+    }
+#endif
     fprintf(stderr, "\n             Memory Usage Summary\n\n");
     fprintf(stderr, "                 Current   Maximum    Items     Percent\n");
     fprintf(stderr, "  Memory Area     usage     used    allocated   in use \n");
@@ -1047,6 +2133,13 @@ void atl_memstat(void) {
             ((long) (atl__env->rsMaxExtent - atl__env->rstack)),
             atl__env->rsLength,
             (100L * (atl__env->rs - atl__env->rstack)) / atl__env->rsLength);
+#ifdef FPSTACK
+    fprintf(stderr, "   %-12s %6ld    %6ld    %6ld       %3ld\n", "Float stack",
+            ((long) (atl__env->fstk - atl__env->fstack)),
+            ((long) (atl__env->fstkMaxExtent - atl__env->fstack)),
+            atl__env->fstkLength,
+            (100L * (atl__env->fstk - atl__env->fstack)) / atl__env->fstkLength);
+#endif
     fprintf(stderr, "   %-12s %6ld    %6ld    %6ld       %3ld\n", "Heap",
             ((long) (atl__env->heapAllocPtr - atl__env->heap)),
             ((long) (atl__env->heapMaxExtent - atl__env->heap)),
@@ -1060,13 +2153,11 @@ void atl_memstat(void) {
  name and initial values for its attributes, returns
  the newly-allocated dictionary item. */
 
-void enter(char *tkname) {
-    /* Allocate name buffer */
-    atl__env->createWord->wname = alloc(((unsigned int) strlen(tkname) + 2));
-    atl__env->createWord->wname[0] = 0;	      /* Clear flags */
-    strcpy(atl__env->createWord->wname + 1, tkname); /* Copy token to name buffer */
+void enter(char *tkname, size_t len) {
+    atl__env->createWord->wname = intern(tkname, len, 0);   /* Intern name, with flags clear */
     atl__env->createWord->wnext = atl__env->dict;	      /* Chain rest of dictionary to word */
     atl__env->dict = atl__env->createWord;		      /* Put word at head of dictionary */
+    dicthash(atl__env->createWord);	      /* and of its hash bucket */
 }
 
 #ifdef Keyhit
@@ -1096,7 +2187,10 @@ Boolean kbquit(void) {
 #   define Compiling if (state == atlFalsity) {notcomp(); return;}
 #endif
 #define Compconst(x) Ho(1); Hstore = (stackitem) (x)
-#define Skipstring atl__env->ip += *((char *) atl__env->ip)
+/* A string compiled in line is the number of cells it takes, then the
+   string itself, terminated. */
+#define Instring   ((char *) (atl__env->ip + 1))
+#define Skipstring atl__env->ip += 1 + (stackitem) *atl__env->ip
 
 /* Add two numbers */
 prim P_plus(void) {
@@ -1547,10 +2641,10 @@ prim P_array(void) {
 /* Push address of string literal */
 prim P_strlit(void) {
     So(1);
-    Push = (stackitem) (((char *) atl__env->ip) + 1);
+    Push = (stackitem) Instring;
 #ifdef TRACE
     if (atl__env->enableTrace) {
-        fprintf(stderr, "\"%s\" ", (((char *) atl__env->ip) + 1));
+        fprintf(stderr, "\"%s\" ", Instring);
     }
 #endif /* TRACE */
     Skipstring; 		      /* Advance IP past it */
@@ -1643,11 +2737,21 @@ prim P_strform(void) {
 
 /* Format real using sprintf() rvalue "%6.2f" str -- */
 prim P_fstrform(void) {
+#ifdef FPSTACK
+    Sl(2);
+    Fsl(1);
+    Hpc(S0);
+    Hpc(S1);
+    sprintf((char *) S0, (char *) S1, F0);
+    Fpop;
+    Pop2;
+#else
     Sl(4);
     Hpc(S0);
     Hpc(S1);
     sprintf((char *) S0, (char *) S1, REAL1);
     Npop(4);
+#endif
 }
 
 /* String to integer  str -- endptr value */
@@ -1664,6 +2768,18 @@ prim P_strint(void) {
 }
 
 /* String to real  str -- endptr value */
+#ifdef FPSTACK
+/* The value goes on the floating point stack */
+prim P_strreal(void) {
+    char *eptr;
+
+    Sl(1);
+    Fso(1);
+    Hpc(S0);
+    Fpush = strtod((char *) S0, &eptr);
+    S0 = (stackitem) eptr;
+}
+#else
 prim P_strreal(void) {
     int i;
     union {
@@ -1681,10 +2797,24 @@ prim P_strreal(void) {
     	Push = fsu.fss[i];
     }
 }
+#endif
 
 /*  Floating point primitives  */
 
 /* Push floating point literal */
+#ifdef FPSTACK
+prim P_flit(void) {
+    Fso(1);
+    memcpy((char *) atl__env->fstk, (char *) atl__env->ip, sizeof(atl_real));
+#ifdef TRACE
+    if (atl__env->enableTrace) {
+        fprintf(stderr, "%g ", *atl__env->fstk);
+    }
+#endif /* TRACE */
+    atl__env->fstk++;
+    atl__env->ip += Realsize;
+}
+#else
 prim P_flit(void) {
     int i;
 
@@ -1701,31 +2831,32 @@ prim P_flit(void) {
         Push = (stackitem) *atl__env->ip++;
     }
 }
+#endif /* FPSTACK */
 
 /* Add floating point numbers */
 prim P_fplus(void) {
-    Sl(2 * Realsize);
+    Realsl(2);
     SREAL1(REAL1 + REAL0);
     Realpop;
 }
 
 /* Subtract floating point numbers */
 prim P_fminus(void) {
-    Sl(2 * Realsize);
+    Realsl(2);
     SREAL1(REAL1 - REAL0);
     Realpop;
 }
 
 /* Multiply floating point numbers */
 prim P_ftimes(void) {
-    Sl(2 * Realsize);
+    Realsl(2);
     SREAL1(REAL1 * REAL0);
     Realpop;
 }
 
 /* Divide floating point numbers */
 prim P_fdiv(void) {
-    Sl(2 * Realsize);
+    Realsl(2);
 #ifndef NOMEMCHECK
     if (REAL0 == 0.0) {
         divzero();
@@ -1738,27 +2869,27 @@ prim P_fdiv(void) {
 
 /* Minimum of top two floats */
 prim P_fmin(void) {
-    Sl(2 * Realsize);
+    Realsl(2);
     SREAL1(min(REAL1, REAL0));
     Realpop;
 }
 
 /* Maximum of top two floats */
 prim P_fmax(void) {
-    Sl(2 * Realsize);
+    Realsl(2);
     SREAL1(max(REAL1, REAL0));
     Realpop;
 }
 
 /* Negate top of stack */
 prim P_fneg(void) {
-    Sl(Realsize);
+    Realsl(1);
     SREAL0(- REAL0);
 }
 
 /* Absolute value of top of stack */
 prim P_fabs(void) {
-    Sl(Realsize);
+    Realsl(1);
     SREAL0(abs(REAL0));
 }
 
@@ -1766,9 +2897,12 @@ prim P_fabs(void) {
 prim P_fequal(void) {
     stackitem t;
 
-    Sl(2 * Realsize);
+    Realsl(2);
     t = (REAL1 == REAL0) ? atlTruth : atlFalsity;
     Realpop2;
+#ifdef FPSTACK
+    So(1);
+#endif
     Push = t;
 }
 
@@ -1776,9 +2910,12 @@ prim P_fequal(void) {
 prim P_funequal(void) {
     stackitem t;
 
-    Sl(2 * Realsize);
+    Realsl(2);
     t = (REAL1 != REAL0) ? atlTruth : atlFalsity;
     Realpop2;
+#ifdef FPSTACK
+    So(1);
+#endif
     Push = t;
 }
 
@@ -1786,9 +2923,12 @@ prim P_funequal(void) {
 prim P_fgtr(void) {
     stackitem t;
 
-    Sl(2 * Realsize);
+    Realsl(2);
     t = (REAL1 > REAL0) ? atlTruth : atlFalsity;
     Realpop2;
+#ifdef FPSTACK
+    So(1);
+#endif
     Push = t;
 }
 
@@ -1796,9 +2936,12 @@ prim P_fgtr(void) {
 prim P_flss(void) {
     stackitem t;
 
-    Sl(2 * Realsize);
+    Realsl(2);
     t = (REAL1 < REAL0) ? atlTruth : atlFalsity;
     Realpop2;
+#ifdef FPSTACK
+    So(1);
+#endif
     Push = t;
 }
 
@@ -1806,9 +2949,12 @@ prim P_flss(void) {
 prim P_fgeq(void) {
     stackitem t;
 
-    Sl(2 * Realsize);
+    Realsl(2);
     t = (REAL1 >= REAL0) ? atlTruth : atlFalsity;
     Realpop2;
+#ifdef FPSTACK
+    So(1);
+#endif
     Push = t;
 }
 
@@ -1816,21 +2962,30 @@ prim P_fgeq(void) {
 prim P_fleq(void) {
     stackitem t;
 
-    Sl(2 * Realsize);
+    Realsl(2);
     t = (REAL1 <= REAL0) ? atlTruth : atlFalsity;
     Realpop2;
+#ifdef FPSTACK
+    So(1);
+#endif
     Push = t;
 }
 
 /* Print floating point top of stack */
 prim P_fdot(void) {
-    Sl(Realsize);
+    Realsl(1);
     fprintf(stderr, "%g ", REAL0);
     Realpop;
 }
 
 /* Convert integer to floating */
 prim P_float(void) {
+#ifdef FPSTACK
+    Sl(1);
+    Fso(1);
+    Fpush = (atl_real) S0;
+    Pop;
+#else
     atl_real r;
 
     Sl(1)
@@ -1838,38 +2993,108 @@ prim P_float(void) {
     r = S0;
     atl__env->stk += Realsize - 1;
     SREAL0(r);
+#endif
 }
 
 /* Convert floating to integer */
 prim P_fix(void) {
     stackitem i;
 
-    Sl(Realsize);
+    Realsl(1);
     i = (int) REAL0;
     Realpop;
+#ifdef FPSTACK
+    So(1);
+#endif
     Push = i;
 }
 
-#define Mathfunc(x) Sl(Realsize); SREAL0(x(REAL0))
+#ifdef FPSTACK
+/*  Floating point stack mechanics  */
 
-/* Arc cosine */
-prim P_acos(void) {
-    Mathfunc(acos);
-}
+/* Duplicate top of floating stack */
+prim P_fdup(void) {
+    atl_real r;
 
-/* Arc sine */
-prim P_asin(void) {
-    Mathfunc(asin);
+    Fsl(1);
+    Fso(1);
+    r = F0;
+    Fpush = r;
 }
 
-/* Arc tangent */
-prim P_atan(void) {
-    Mathfunc(atan);
+/* Drop top of floating stack */
+prim P_fdrop(void) {
+    Fsl(1);
+    Fpop;
+}
+
+/* Exchange two top items on floating stack */
+prim P_fswap(void) {
+    atl_real r;
+
+    Fsl(2);
+    r = F1;
+    F1 = F0;
+    F0 = r;
+}
+
+/* Push copy of next to top of floating stack */
+prim P_fover(void) {
+    atl_real r;
+
+    Fsl(2);
+    Fso(1);
+    r = F1;
+    Fpush = r;
+}
+
+/* Push floating stack depth */
+prim P_fdepth(void) {
+    So(1);
+    Push = atl__env->fstk - atl__env->fstack;
+}
+
+/* Fetch real from address  addr -- */
+prim P_fat(void) {
+    Sl(1);
+    Fso(1);
+    Hpc(S0);
+    memcpy((char *) atl__env->fstk, (char *) S0, sizeof(atl_real));
+    atl__env->fstk++;
+    Pop;
+}
+
+/* Store real at address  addr -- */
+prim P_fbang(void) {
+    Sl(1);
+    Fsl(1);
+    Hpc(S0);
+    Fpop;
+    memcpy((char *) S0, (char *) atl__env->fstk, sizeof(atl_real));
+    Pop;
+}
+#endif /* FPSTACK */
+
+#define Mathfunc(x) Realsl(1); SREAL0(x(REAL0))
+
+/* Arc cosine */
+prim P_acos(void) {
+    Mathfunc(acos);
+}
+
+/* Arc sine */
+prim P_asin(void) {
+    Mathfunc(asin);
+}
+
+/* Arc tangent */
+prim P_atan(void) {
+    Mathfunc(atan);
 }
 
 /* Arc tangent:  y x -- atan */
 prim P_atan2(void) {
-    Sl(2 * Realsize);
+    Realsl(2);
     SREAL1(atan2(REAL1, REAL0));
     Realpop;
 }
@@ -1891,7 +3116,7 @@ prim P_log(void) {
 
 /* X ^ Y */
 prim P_pow(void) {
-    Sl(2 * Realsize);
+    Realsl(2);
     SREAL1(pow(REAL1, REAL0));
     Realpop;
 }
@@ -1914,15 +3139,23 @@ prim P_tan(void) {
 
 /*  Console I/O primitives  */
 
+// dotnum(n) -- print n, signed, in the current base and a space
+//
+static void dotnum(stackitem n) {
+    if (atl__env->currentNumberBase != 16) {
+        fprintf(stderr, "%ld ", n);
+    } else if (n < 0) {
+        fprintf(stderr, "-%lX ", 0UL - (unsigned long) n);
+    } else {
+        fprintf(stderr, "%lX ", (unsigned long) n);
+    }
+}
+
 // . -- print top of stack, pop it
 //
 prim P_dot(void) {
     Sl(1);
-    if (atl__env->currentNumberBase == 16) {
-        fprintf(stderr, "%lX ", S0);
-    } else {
-        fprintf(stderr, "%ld ", S0);
-    }
+    dotnum(S0);
     Pop;
 }
 
@@ -1931,11 +3164,7 @@ prim P_dot(void) {
 prim P_question(void) {
     Sl(1);
     Hpc(S0);
-    if (atl__env->currentNumberBase == 16) {
-        fprintf(stderr, "%lX ", *((stackitem *) S0));
-    } else {
-        fprintf(stderr, "%ld ", *((stackitem *) S0));
-    }
+    dotnum(*((stackitem *) S0));
     Pop;
 }
 
@@ -1955,15 +3184,23 @@ prim P_dots(void) {
         fprintf(stderr, "empty.");
     } else {
         for (tsp = atl__env->stack; tsp < atl__env->stk; tsp++) {
-            if (atl__env->currentNumberBase == 16) {
-                fprintf(stderr, "%lX ", *tsp);
-            } else {
-                fprintf(stderr, "%ld ", *tsp);
-            }
+            dotnum(*tsp);
         }
     }
 }
 
+// hex -- numbers are read and printed in base 16
+//
+prim P_hex(void) {
+    atl__env->currentNumberBase = 16;
+}
+
+// decimal -- numbers are read and printed in base 10
+//
+prim P_decimal(void) {
+    atl__env->currentNumberBase = 10;
+}
+
 /* Print literal string that follows */
 prim P_dotquote(void) {
     Compiling;
@@ -1976,7 +3213,7 @@ prim P_dotparen(void) {
     if (atl__env->ip == NULL) {		      /* If interpreting */
         atl__env->tokPendingStringLiteral = atlTrue;	      /* Set to print next string constant */
     } else {			      /* Otherwise, */
-        fprintf(stderr, "%s", ((char *) atl__env->ip) + 1); /* print string literal in in-line code. */
+        fprintf(stderr, "%s", Instring); /* print string literal in in-line code. */
         Skipstring;		      /* And advance IP past it */
     }
 }
@@ -1995,8 +3232,9 @@ prim P_words(void) {
     dictword *dw = atl__env->dict;
 
     while (dw != NULL) {
-
-        fprintf(stderr, "\n%s", dw->wname + 1);
+        if (!(*(dw->wname) & WORDHIDDEN)) {
+            fprintf(stderr, "\n%s", dw->wname + 1);
+        }
         dw = dw->wnext;
     }
     fprintf(stderr, "\n");
@@ -2177,6 +3415,15 @@ prim P_evaluate(void) {
     Push = es;			      /* Return eval status on top of stack */
 }
 
+#ifdef IMAGE
+/* Save an image of what's been compiled:  path -- status */
+prim P_saveimage(void) {
+    Sl(1);
+    Hpc(S0);
+    S0 = atl_save_image((char *) S0);
+}
+#endif
+
 /*  Stack mechanics  */
 
 /* Push stack depth */
@@ -2423,17 +3670,22 @@ prim P_dolit(void) {
 prim P_nest(void) {
     Rso(1);
 #ifdef WALKBACK
-    *atl__env->walkbackPointer++ = atl__env->currentWord;   // append word to walkback stack
+    if (atl__env->enableWalkback) {
+        *atl__env->walkbackPointer++ = atl__env->currentWord;   // append word to walkback stack
+    }
 #endif
     Rpush = atl__env->ip; 		      /* Push instruction pointer */
     atl__env->ip = (((dictword **) atl__env->currentWord) + Dictwordl);
+    Bpoll;
 }
 
 /* Return to top of return stack */
 prim P_exit(void) {
     Rsl(1);
 #ifdef WALKBACK
-    atl__env->walkbackPointer = (atl__env->walkbackPointer > atl__env->walkback) ? atl__env->walkbackPointer - 1 : atl__env->walkback;
+    if (atl__env->enableWalkback) {
+        atl__env->walkbackPointer = (atl__env->walkbackPointer > atl__env->walkback) ? atl__env->walkbackPointer - 1 : atl__env->walkback;
+    }
 #endif
     atl__env->ip = R0;			      /* Set IP to top of return stack */
     Rpop;
@@ -2441,19 +3693,302 @@ prim P_exit(void) {
 
 /* Jump to in-line address */
 prim P_branch(void) {
-    atl__env->ip += (stackitem) *atl__env->ip;	      /* Jump addresses are IP-relative */
+    stackitem offset = (stackitem) *atl__env->ip;
+
+    atl__env->ip += offset;	      /* Jump addresses are IP-relative */
+    if (offset < 0) {
+        Bpoll;			      /* Backward: may be looping */
+    }
 }
 
 /* Conditional branch to in-line addr */
 prim P_qbranch(void) {
     Sl(1);
-    if (S0 == 0)		      /* If flag is false */
-        atl__env->ip += (stackitem) *atl__env->ip;	      /* then branch. */
-    else			      /* Otherwise */
+    if (S0 == 0) {		      /* If flag is false */
+        stackitem offset = (stackitem) *atl__env->ip;
+
+        atl__env->ip += offset;	      /* then branch. */
+        Pop;
+        if (offset < 0) {
+            Bpoll;
+        }
+    } else {			      /* Otherwise */
         atl__env->ip++;			      /* skip the in-line address. */
+        Pop;
+    }
+}
+
+#ifdef SUPERINST
+/*  Superinstructions.  These are compiled only by fuse() when ;
+    rewrites a definition, and each does the work of the sequence
+    named in its comment in a single dispatch.  */
+
+/* (LIT) n +  */
+prim P_litplus(void) {
+    Sl(1);
+#ifdef TRACE
+    if (atl__env->enableTrace) {
+        fprintf(stderr, "%ld ", (long) *atl__env->ip);
+    }
+#endif
+    S0 += (stackitem) *atl__env->ip++;
+}
+
+/* (LIT) n = ?BRANCH offset  */
+prim P_liteqqbranch(void) {
+    Sl(1);
+    if (S0 == (stackitem) atl__env->ip[0]) {   /* If equal to the literal */
+        atl__env->ip += 2;		      /* skip literal and in-line address. */
+        Pop;
+    } else {			      /* Otherwise */
+        stackitem offset = (stackitem) atl__env->ip[1];
+
+        atl__env->ip += 1 + offset;	      /* branch. */
+        Pop;
+        if (offset < 0) {
+            Bpoll;
+        }
+    }
+}
+
+/* DUP @  */
+prim P_dupat(void) {
+    stackitem s;
+
+    Sl(1);
+    So(1);
+    Hpc(S0);
+    s = *((stackitem *) S0);
+    Push = s;
+}
+
+/* I +  */
+prim P_iplus(void) {
+    Rsl(3);
+    Sl(1);
+    S0 += (stackitem) R0;
+}
+
+/* @ +  */
+prim P_atplus(void) {
+    Sl(2);
+    Hpc(S0);
+    S1 += *((stackitem *) S0);
+    Pop;
+}
+#endif /* SUPERINST */
+
+#ifdef STACKEFFECT
+/*  Stack depth check and unchecked primitives.  stackeffect() puts
+    (CHECK) need grow net at the start of a definition whose stack
+    effect it could work out, and replaces the primitives in its body
+    with the variants below, which leave out the Sl and So checks that
+    (CHECK) has made for the whole definition.  */
+
+/* Check the stack once for the whole definition */
+prim P_stackcheck(void) {
+    Sl((stackitem) atl__env->ip[0]);
+    So((stackitem) atl__env->ip[1]);
+    atl__env->ip += 3;
+}
+
+/* +, unchecked */
+prim U_plus(void) {
+    S1 += S0;
+    Pop;
+}
+
+/* -, unchecked */
+prim U_minus(void) {
+    S1 -= S0;
+    Pop;
+}
+
+/* *, unchecked */
+prim U_times(void) {
+    S1 *= S0;
+    Pop;
+}
+
+/* NEGATE, unchecked */
+prim U_neg(void) {
+    S0 = - S0;
+}
+
+/* =, unchecked */
+prim U_equal(void) {
+    S1 = (S1 == S0) ? atlTruth : atlFalsity;
+    Pop;
+}
+
+/* <>, unchecked */
+prim U_unequal(void) {
+    S1 = (S1 != S0) ? atlTruth : atlFalsity;
+    Pop;
+}
+
+/* >, unchecked */
+prim U_gtr(void) {
+    S1 = (S1 > S0) ? atlTruth : atlFalsity;
+    Pop;
+}
+
+/* <, unchecked */
+prim U_lss(void) {
+    S1 = (S1 < S0) ? atlTruth : atlFalsity;
+    Pop;
+}
+
+/* >=, unchecked */
+prim U_geq(void) {
+    S1 = (S1 >= S0) ? atlTruth : atlFalsity;
+    Pop;
+}
+
+/* <=, unchecked */
+prim U_leq(void) {
+    S1 = (S1 <= S0) ? atlTruth : atlFalsity;
+    Pop;
+}
+
+/* AND, unchecked */
+prim U_and(void) {
+    S1 &= S0;
+    Pop;
+}
+
+/* OR, unchecked */
+prim U_or(void) {
+    S1 |= S0;
+    Pop;
+}
+
+/* XOR, unchecked */
+prim U_xor(void) {
+    S1 ^= S0;
+    Pop;
+}
+
+/* NOT, unchecked */
+prim U_not(void) {
+    S0 = ~S0;
+}
+
+/* 1+, unchecked */
+prim U_1plus(void) {
+    S0++;
+}
+
+/* 1-, unchecked */
+prim U_1minus(void) {
+    S0--;
+}
+
+/* 0=, unchecked */
+prim U_0equal(void) {
+    S0 = (S0 == 0) ? atlTruth : atlFalsity;
+}
+
+/* 0<, unchecked */
+prim U_0lss(void) {
+    S0 = (S0 < 0) ? atlTruth : atlFalsity;
+}
+
+/* DUP, unchecked */
+prim U_dup(void) {
+    stackitem s = S0;
+
+    Push = s;
+}
+
+/* DROP, unchecked */
+prim U_drop(void) {
     Pop;
 }
 
+/* SWAP, unchecked */
+prim U_swap(void) {
+    stackitem t = S1;
+
+    S1 = S0;
+    S0 = t;
+}
+
+/* OVER, unchecked */
+prim U_over(void) {
+    stackitem s = S1;
+
+    Push = s;
+}
+
+/* ROT, unchecked */
+prim U_rot(void) {
+    stackitem t = S0;
+
+    S0 = S2;
+    S2 = S1;
+    S1 = t;
+}
+
+/* -ROT, unchecked */
+prim U_minusrot(void) {
+    stackitem t = S0;
+
+    S0 = S1;
+    S1 = S2;
+    S2 = t;
+}
+
+/* @, unchecked */
+prim U_at(void) {
+    Hpc(S0);
+    S0 = *((stackitem *) S0);
+}
+
+/* !, unchecked */
+prim U_bang(void) {
+    Hpc(S0);
+    *((stackitem *) S0) = S1;
+    Pop2;
+}
+
+/* +!, unchecked */
+prim U_plusbang(void) {
+    Hpc(S0);
+    *((stackitem *) S0) += S1;
+    Pop2;
+}
+
+/* C@, unchecked */
+prim U_cat(void) {
+    Hpc(S0);
+    S0 = *((unsigned char *) S0);
+}
+
+/* C!, unchecked */
+prim U_cbang(void) {
+    Hpc(S0);
+    *((unsigned char *) S0) = S1;
+    Pop2;
+}
+
+/* (LIT), unchecked */
+prim U_dolit(void) {
+#ifdef TRACE
+    if (atl__env->enableTrace) {
+        fprintf(stderr, "%ld ", (long) *atl__env->ip);
+    }
+#endif
+    Push = (stackitem) *atl__env->ip++;
+}
+
+/* I, unchecked */
+prim U_i(void) {
+    Rsl(3);
+    Push = (stackitem) R0;
+}
+#endif /* STACKEFFECT */
+
 // if -- Compile IF word
 //
 prim P_if(void) {
@@ -2653,6 +4188,7 @@ prim P_xloop(void) {
         atl__env->ip++;			      /* Skip the jump address */
     } else {
         atl__env->ip += (stackitem) *atl__env->ip;
+        Bpoll;
     }
 }
 
@@ -2672,6 +4208,7 @@ prim P_xploop(void) {
     } else {
         atl__env->ip += (stackitem) *atl__env->ip;
         R0 = (rstackitem) niter;
+        Bpoll;
     }
 }
 
@@ -2703,11 +4240,16 @@ prim P_quit(void) {
     atl__env->walkbackPointer = atl__env->walkback;
 #endif
     atl__env->ip = NULL;			      /* Stop execution of current word */
+    atl__env->parkedIp = NULL;
+    atl__env->suspendedIp = NULL;
 }
 
 /* Abort, clearing data stack */
 prim P_abort(void) {
     P_clear();			      /* Clear the data stack */
+#ifdef FPSTACK
+    atl__env->fstk = atl__env->fstack;	      /* And the floating point stack */
+#endif
     P_quit();			      /* Shut down execution */
 }
 
@@ -2717,7 +4259,7 @@ prim P_abortq(void) {
         atl__env->tokPendingStringLiteral = atlTrue;	      /* Set string literal expected */
         Compconst(atl__env->s_abortq);	      /* Compile ourselves */
     } else {
-        fprintf(stderr, "%s", (char *) atl__env->ip);  // otherwise, print string literal in in-line code.
+        fprintf(stderr, "%s", Instring);  // otherwise, print string literal in in-line code.
 #ifdef WALKBACK
         pwalkback();
 #endif /* WALKBACK */
@@ -2752,7 +4294,9 @@ Exported void P_dodoes(void) {
     So(1);
     Rpush = atl__env->ip; 		      /* Push instruction pointer */
 #ifdef WALKBACK
-    *atl__env->walkbackPointer++ = atl__env->currentWord;   // append word to walkback stack
+    if (atl__env->enableWalkback) {
+        *atl__env->walkbackPointer++ = atl__env->currentWord;   // append word to walkback stack
+    }
 #endif
     /* The compiler having craftily squirreled away the DOES> clause
      address before the word definition on the heap, we back up to
@@ -2815,7 +4359,9 @@ prim P_does(void) {
 
         atl__env->ip = R0;		      // Set IP to top of return stack
 #ifdef WALKBACK
-        atl__env->walkbackPointer = (atl__env->walkbackPointer > atl__env->walkback) ? atl__env->walkbackPointer - 1 : atl__env->walkback;
+        if (atl__env->enableWalkback) {
+            atl__env->walkbackPointer = (atl__env->walkbackPointer > atl__env->walkback) ? atl__env->walkbackPointer - 1 : atl__env->walkback;
+        }
 #endif
         Rpop;			      // Pop the return stack
     }
@@ -2828,6 +4374,16 @@ prim P_colon(void) {
     P_create(); 		      // Create conventional word
 }
 
+#ifdef SUPERINST
+static void fuse(dictword *dw);
+#endif
+#ifdef NATIVECODE
+static void jit(dictword *dw, Boolean expand);
+#endif
+#ifdef STACKEFFECT
+static void stackeffect(dictword *dw);
+#endif
+
 // ; -- end compilation
 //
 prim P_semicolon(void) {
@@ -2839,7 +4395,27 @@ prim P_semicolon(void) {
     // We wait until now to plug the P_nest code so that it will be
     // present only in completed definitions.
     if (atl__env->createWord != NULL) {
+#ifdef SUPERINST
+        if (atl__env->enableFusion) {
+            fuse(atl__env->createWord);
+        }
+#endif
         atl__env->createWord->wcode = P_nest;   // Use P_nest for code
+#ifdef JIT
+        if (atl__env->enableJit) {
+            jit(atl__env->createWord, atlTrue); // Replace it with machine code if we can
+        }
+#endif
+#ifdef SUBTHREAD
+        if (atl__env->enableSubthread && atl__env->createWord->wcode == P_nest) {
+            jit(atl__env->createWord, atlFalse); // Or with calls, if JIT didn't
+        }
+#endif
+#ifdef STACKEFFECT
+        if (atl__env->enableStackEffect && atl__env->createWord->wcode == P_nest) {
+            stackeffect(atl__env->createWord); // Check the stack once, if we can
+        }
+#endif
     }
     atl__env->createWord = NULL;		      // Flag no word being created
 }
@@ -2857,12 +4433,11 @@ prim P_tick(void) {
         if (i == TokWord) {
             dictword *di;
 
-            ucase(atl__env->tokbuf);
-            if ((di = lookup(atl__env->tokbuf)) != NULL) {
+            if ((di = lookup(atl__env->tokptr, atl__env->toklen)) != NULL) {
                 So(1);
                 Push = (stackitem) di; /* Push word compile address */
             } else {
-                fprintf(stderr, " '%s' undefined ", atl__env->tokbuf);
+                fprintf(stderr, " '%.*s' undefined ", (int) atl__env->toklen, atl__env->tokptr);
             }
         } else {
             fprintf(stderr, "\nword not specified when expected.\n");
@@ -2922,9 +4497,7 @@ prim P_find(void) {
     Sl(1);
     So(1);
     Hpc(S0);
-    strcpy(atl__env->tokbuf, (char *) S0);        // Use built-in token buffer...
-    dw = lookup(atl__env->tokbuf);                // So ucase() in lookup() doesn't wipe
-    // the token on the stack
+    dw = lookup((char *) S0, strlen((char *) S0));
     if (dw != NULL) {
         S0 = (stackitem) dw;
         // Push immediate flag
@@ -3012,7 +4585,7 @@ prim P_fetchname(void) {
     Hpc(S0);
     Hpc(S1);
     /* Since the name buffers aren't in the system heap, but
-     rather are separately allocated with alloc(), we can't
+     rather are kept in the name arena, we can't
      check the name pointer references.  But, hey, if the user's
      futzing with word dictionary items on the heap in the first
      place, there's a billion other ways to bring us down at
@@ -3023,27 +4596,136 @@ prim P_fetchname(void) {
 
 /* Store string buffer in word name */
 prim P_storename(void) {
-    char tflags;
-    char *cp;
+    struct dname *old, *dn;
+    size_t n;
 
     Sl(2);			      /* string nfa -- */
     Hpc(S0);			      /* See comments in P_fetchname above */
     Hpc(S1);			      /* checking name pointers */
-    tflags = **((char **) S0);
-    free(*((char **) S0));
-    *((char **) S0) = cp = alloc((unsigned int) (strlen((char *) S1) + 2));
-    strcpy(cp + 1, (char *) S1);
-    *cp = tflags;
+    /* The new name gets a struct dname of its own, off the arena, so
+       it can't be lost when the arena is cut back under an older word.
+       The old one is freed if it was such a name too, or left in the
+       arena until that's cut back past it. */
+    old = Dname(*((char **) S0));
+    n = strlen((char *) S1);
+    if (n > 255) {
+        n = 255;
+    }
+    dn = (struct dname *) alloc((unsigned int) Namesize(n));
+    namefill(dn, (char *) S1, n, old->nflags);
+    dn->nlist = old->nlist;
+    dn->nheap = 1;
+    if (old->nheap) {
+        free(old);
+    }
+    *((char **) S0) = &dn->nflags;
     Pop2;
+    dictrehash(dn->nlist, dn->nlist->lmask + 1);   /* The word may belong in another bucket */
 }
 
-#ifdef SYSTEM
-// string -- status
-//
-prim P_system(void) {
-    Sl(1);
-    Hpc(S0);
-    S0 = system((char *) S0);
+/* Make a new, empty wordlist */
+prim P_wordlist(void) {
+    struct wordlist *wl;
+
+    So(1);			      /* -- wid */
+    Ho(Wordlistl);
+    wl = (struct wordlist *) atl__env->heapAllocPtr;
+    atl__env->heapAllocPtr += Wordlistl;
+    wl->lhash = NULL;
+    wl->lmask = 0;
+    wl->lcount = 0;
+    wl->lnext = atl__env->wordlists;
+    atl__env->wordlists = wl;
+    Push = (stackitem) wl;
+}
+
+/* Push the wordlist holding the primitives */
+prim P_forthwordlist(void) {
+    So(1);			      /* -- wid */
+    Push = (stackitem) &atl__env->forth;
+}
+
+/* Push the wordlist new definitions go in */
+prim P_getcurrent(void) {
+    So(1);			      /* -- wid */
+    Push = (stackitem) atl__env->current;
+}
+
+/* Set the wordlist new definitions go in */
+prim P_setcurrent(void) {
+    Sl(1);			      /* wid -- */
+    atl__env->current = (struct wordlist *) S0;
+    Pop;
+}
+
+/* Put new definitions in the first wordlist of the search order */
+prim P_definitions(void) {
+    if (atl__env->orderDepth > 0) {
+        atl__env->current = atl__env->order[0];
+    }
+}
+
+/* Push the search order */
+prim P_getorder(void) {
+    int i;
+
+    So(atl__env->orderDepth + 1);     /* -- widn ... wid1 n */
+    for (i = atl__env->orderDepth - 1; i >= 0; i--) {
+        Push = (stackitem) atl__env->order[i];
+    }
+    Push = atl__env->orderDepth;
+}
+
+/* Set the search order, wid1 first; -1 for FORTH-WORDLIST alone */
+prim P_setorder(void) {
+    stackitem n;
+    int i;
+
+    Sl(1);			      /* widn ... wid1 n -- */
+    n = S0;
+    if (n == -1) {
+        atl__env->order[0] = &atl__env->forth;
+        atl__env->orderDepth = 1;
+        Pop;
+        return;
+    }
+    if (n < 0 || n > Wordorder) {
+        trouble("Bad search order");
+        return;
+    }
+    Sl(n + 1);
+    for (i = 0; i < n; i++) {
+        atl__env->order[i] = (struct wordlist *) atl__env->stk[-2 - i];
+    }
+    atl__env->orderDepth = (int) n;
+    Npop(n + 1);
+}
+
+/* Look up a word in one wordlist */
+prim P_searchwordlist(void) {
+    dictword *dw;
+    size_t len;
+
+    Sl(2);			      /* string wid -- 0 | word 1 | word -1 */
+    Hpc(S1);
+    len = min(strlen((char *) S1), Namemax);
+    dw = wlsearch((struct wordlist *) S0, (char *) S1, namehash((char *) S1, len), len);
+    Pop;
+    if (dw != NULL) {
+        S0 = (stackitem) dw;
+        Push = (dw->wname[0] & IMMEDIATE) ? 1 : -1;
+    } else {
+        S0 = 0;
+    }
+}
+
+#ifdef SYSTEM
+// string -- status
+//
+prim P_system(void) {
+    Sl(1);
+    Hpc(S0);
+    S0 = system((char *) S0);
 }
 #endif /* SYSTEM */
 
@@ -3052,7 +4734,83 @@ prim P_trace(void) {
     Sl(1);
     atl__env->enableTrace = (S0 == 0) ? atlFalsity : atlTruth;
     Pop;
+    reinstrument();
+}
+
+#ifdef SUPERINST
+/* Set or clear superinstruction fusion at ; */
+prim P_fuse(void) {
+    Sl(1);
+    atl__env->enableFusion = (S0 == 0) ? atlFalsity : atlTruth;
+    Pop;
+}
+
+/* Start (clearing counts) or stop counting candidate sequences */
+prim P_fuseprofile(void) {
+    Sl(1);
+    if (S0 != 0) {
+        memset(atl__env->fuseCounts, 0, sizeof(atl__env->fuseCounts));
+        atl__env->fuseHistory[0] = atl__env->fuseHistory[1] = NULL;
+    }
+    atl__env->fuseProfiling = (S0 == 0) ? atlFalse : atlTrue;
+    Pop;
+    reinstrument();
+}
+
+/* Enable only the rules whose sequence ran at least n times */
+prim P_fuseselect(void) {
+    int i;
+
+    Sl(1);
+    atl__env->fuseMask = 0;
+    for (i = 0; i < FuseRules; i++) {
+        if (atl__env->fuseCounts[i] >= S0) {
+            atl__env->fuseMask |= 1L << i;
+        }
+    }
+    Pop;
+}
+
+/* Print candidate sequence counts and the rules enabled */
+prim P_fusestat(void) {
+    static char *rulename[FuseRules] = {
+        "(LIT+)", "(LIT=?BRANCH)", "(DUP@)", "2DUP", "(I+)", "(@+)"
+    };
+    int i;
+
+    for (i = 0; i < FuseRules; i++) {
+        fprintf(stderr, "%-14s %10ld%s\n", rulename[i], atl__env->fuseCounts[i],
+                (atl__env->fuseMask & (1L << i)) ? "" : "  (off)");
+    }
+}
+#endif /* SUPERINST */
+
+#ifdef JIT
+/* Set or clear translation to machine code at ; */
+prim P_jit(void) {
+    Sl(1);
+    atl__env->enableJit = (S0 == 0) ? atlFalsity : atlTruth;
+    Pop;
+}
+#endif /* JIT */
+
+#ifdef SUBTHREAD
+/* Set or clear subroutine-threaded code generation at ; */
+prim P_subthread(void) {
+    Sl(1);
+    atl__env->enableSubthread = (S0 == 0) ? atlFalsity : atlTruth;
+    Pop;
+}
+#endif /* SUBTHREAD */
+
+#ifdef STACKEFFECT
+/* Set or clear checking the stack once per definition at ; */
+prim P_stackeffect(void) {
+    Sl(1);
+    atl__env->enableStackEffect = (S0 == 0) ? atlFalsity : atlTruth;
+    Pop;
 }
+#endif /* STACKEFFECT */
 
 /* Set or clear error walkback */
 prim P_walkback(void) {
@@ -3066,7 +4824,7 @@ prim P_wordsused(void) {
     dictword *dw = atl__env->dict;
 
     while (dw != NULL) {
-        if (*(dw->wname) & WORDUSED) {
+        if ((*(dw->wname) & (WORDUSED | WORDHIDDEN)) == WORDUSED) {
             fprintf(stderr, "\n%s", dw->wname + 1);
         }
         dw = dw->wnext;
@@ -3079,7 +4837,7 @@ prim P_wordsunused(void) {
     dictword *dw = atl__env->dict;
 
     while (dw != NULL) {
-        if (!(*(dw->wname) & WORDUSED)) {
+        if (!(*(dw->wname) & (WORDUSED | WORDHIDDEN))) {
             fprintf(stderr, "\n%s", dw->wname + 1);
         }
         dw = dw->wnext;
@@ -3253,6 +5011,15 @@ static struct primfcn primt[] = {
     {"0F.", P_fdot},
     {"0FLOAT", P_float},
     {"0FIX", P_fix},
+#ifdef FPSTACK
+    {"0FDUP", P_fdup},
+    {"0FDROP", P_fdrop},
+    {"0FSWAP", P_fswap},
+    {"0FOVER", P_fover},
+    {"0FDEPTH", P_fdepth},
+    {"0F@", P_fat},
+    {"0F!", P_fbang},
+#endif
     {"0ACOS", P_acos},
     {"0ASIN", P_asin},
     {"0ATAN", P_atan},
@@ -3295,6 +5062,58 @@ static struct primfcn primt[] = {
     {"0SYSTEM", P_system},
     {"0TRACE", P_trace},
     {"0WALKBACK", P_walkback},
+#ifdef SUPERINST
+    {"0(LIT+)", P_litplus},
+    {"0(LIT=?BRANCH)", P_liteqqbranch},
+    {"0(DUP@)", P_dupat},
+    {"0(I+)", P_iplus},
+    {"0(@+)", P_atplus},
+    {"0FUSE", P_fuse},
+    {"0FUSEPROFILE", P_fuseprofile},
+    {"0FUSESELECT", P_fuseselect},
+    {"0FUSESTAT", P_fusestat},
+#endif
+#ifdef JIT
+    {"0JIT", P_jit},
+#endif
+#ifdef SUBTHREAD
+    {"0SUBTHREAD", P_subthread},
+#endif
+#ifdef STACKEFFECT
+    {"0STACKEFFECT", P_stackeffect},
+    {"4(CHECK)", P_stackcheck},
+    {"4+", U_plus},
+    {"4-", U_minus},
+    {"4*", U_times},
+    {"4NEGATE", U_neg},
+    {"4=", U_equal},
+    {"4<>", U_unequal},
+    {"4>", U_gtr},
+    {"4<", U_lss},
+    {"4>=", U_geq},
+    {"4<=", U_leq},
+    {"4AND", U_and},
+    {"4OR", U_or},
+    {"4XOR", U_xor},
+    {"4NOT", U_not},
+    {"41+", U_1plus},
+    {"41-", U_1minus},
+    {"40=", U_0equal},
+    {"40<", U_0lss},
+    {"4DUP", U_dup},
+    {"4DROP", U_drop},
+    {"4SWAP", U_swap},
+    {"4OVER", U_over},
+    {"4ROT", U_rot},
+    {"4-ROT", U_minusrot},
+    {"4@", U_at},
+    {"4!", U_bang},
+    {"4+!", U_plusbang},
+    {"4C@", U_cat},
+    {"4C!", U_cbang},
+    {"4(LIT)", U_dolit},
+    {"4I", U_i},
+#endif
     {"0WORDSUSED", P_wordsused},
     {"0WORDSUNUSED", P_wordsunused},
     {"0MEMSTAT", atl_memstat},
@@ -3321,6 +5140,14 @@ static struct primfcn primt[] = {
     {"0L>NAME", P_linktoname},
     {"0NAME>S!", P_fetchname},
     {"0S>NAME!", P_storename},
+    {"0WORDLIST", P_wordlist},
+    {"0FORTH-WORDLIST", P_forthwordlist},
+    {"0GET-CURRENT", P_getcurrent},
+    {"0SET-CURRENT", P_setcurrent},
+    {"0DEFINITIONS", P_definitions},
+    {"0GET-ORDER", P_getorder},
+    {"0SET-ORDER", P_setorder},
+    {"0SEARCH-WORDLIST", P_searchwordlist},
     {"1[COMPILE]", P_brackcompile},
     {"1LITERAL", P_literal},
     {"0COMPILE", P_compile},
@@ -3332,6 +5159,8 @@ static struct primfcn primt[] = {
     {"0?", P_question},
     {"0CR", P_cr},
     {"0.S", P_dots},
+    {"0HEX", P_hex},
+    {"0DECIMAL", P_decimal},
     {"1.\"", P_dotquote},
     {"1.(", P_dotparen},
     {"0TYPE", P_type},
@@ -3350,9 +5179,49 @@ static struct primfcn primt[] = {
     {"0FSEEK", P_fseek},
     {"0FLOAD", P_fload},
     {"0EVALUATE", P_evaluate},
+#ifdef IMAGE
+    {"0SAVE-IMAGE", P_saveimage},
+#endif
     {NULL, (codeptr) 0}
 };
 
+#ifdef STACKEFFECT
+// Stack effects of the primitives stackeffect() can follow: the items
+// each takes and leaves, and the variant to use once the definition has
+// checked the stack on entry, if there is one.  Branches, loops and
+// EXIT are handled by stackeffect() itself.
+static struct primeffect {
+    codeptr pcode;
+    signed char pin, pout;
+    codeptr unchecked;
+} effectt[] = {
+    {P_plus, 2, 1, U_plus},         {P_minus, 2, 1, U_minus},       {P_times, 2, 1, U_times},
+    {P_div, 2, 1, NULL},            {P_mod, 2, 1, NULL},            {P_divmod, 2, 2, NULL},
+    {P_min, 2, 1, NULL},            {P_max, 2, 1, NULL},            {P_neg, 1, 1, U_neg},
+    {P_abs, 1, 1, NULL},            {P_equal, 2, 1, U_equal},       {P_unequal, 2, 1, U_unequal},
+    {P_gtr, 2, 1, U_gtr},           {P_lss, 2, 1, U_lss},           {P_geq, 2, 1, U_geq},
+    {P_leq, 2, 1, U_leq},           {P_and, 2, 1, U_and},           {P_or, 2, 1, U_or},
+    {P_xor, 2, 1, U_xor},           {P_not, 1, 1, U_not},           {P_depth, 0, 1, NULL},
+    {P_dup, 1, 2, U_dup},           {P_drop, 1, 0, U_drop},         {P_swap, 2, 2, U_swap},
+    {P_over, 2, 3, U_over},         {P_rot, 3, 3, U_rot},           {P_minusrot, 3, 3, U_minusrot},
+    {P_tor, 1, 0, NULL},            {P_rfrom, 0, 1, NULL},          {P_rfetch, 0, 1, NULL},
+    {P_1plus, 1, 1, U_1plus},       {P_2plus, 1, 1, NULL},          {P_1minus, 1, 1, U_1minus},
+    {P_2minus, 1, 1, NULL},         {P_2times, 1, 1, NULL},         {P_2div, 1, 1, NULL},
+    {P_0equal, 1, 1, U_0equal},     {P_0notequal, 1, 1, NULL},      {P_0gtr, 1, 1, NULL},
+    {P_0lss, 1, 1, U_0lss},         {P_2dup, 2, 4, NULL},           {P_2drop, 2, 0, NULL},
+    {P_2swap, 4, 4, NULL},          {P_2over, 4, 6, NULL},          {P_2bang, 3, 0, NULL},
+    {P_2at, 1, 2, NULL},            {P_bang, 2, 0, U_bang},         {P_at, 1, 1, U_at},
+    {P_plusbang, 2, 0, U_plusbang}, {P_cbang, 2, 0, U_cbang},       {P_cat, 1, 1, U_cat},
+    {P_here, 0, 1, NULL},           {P_strlit, 0, 1, NULL},         {P_dolit, 0, 1, U_dolit},
+    {P_i, 0, 1, U_i},               {P_j, 0, 1, NULL},              {P_dot, 1, 0, NULL},
+    {P_cr, 0, 0, NULL},             {P_dotparen, 0, 0, NULL},       {P_type, 1, 0, NULL},
+#ifdef SUPERINST
+    {P_litplus, 1, 1, NULL},        {P_dupat, 1, 2, NULL},          {P_iplus, 1, 1, NULL},
+    {P_atplus, 2, 1, NULL},
+#endif
+};
+#endif /* STACKEFFECT */
+
 // ATL_PRIMDEF
 // Initialise the dictionary with the built-in primitive
 // words.  To save the memory overhead of separately
@@ -3363,8 +5232,6 @@ void atl_primdef(struct primfcn *pt) {
     struct primfcn *pf = pt;
     dictword *nw;
     int i, n = 0;
-    unsigned int nltotal;
-    char *dynames, *cp;
 
     /* Count the number of definitions in the table. */
 
@@ -3373,29 +5240,14 @@ void atl_primdef(struct primfcn *pt) {
         pf++;
     }
 
-#ifdef READONLYSTRINGS
-    nltotal = n;
-    for (i = 0; i < n; i++) {
-        nltotal += strlen(pt[i].pname);
-    }
-    cp = dynames = alloc(nltotal);
-    for (i = 0; i < n; i++) {
-        strcpy(cp, pt[i].pname);
-        cp += strlen(cp) + 1;
-    }
-    cp = dynames;
-#endif /* READONLYSTRINGS */
-
     nw = (dictword *) alloc((unsigned int) (n * sizeof(dictword)));
 
     nw[n - 1].wnext = atl__env->dict;
     atl__env->dict = nw;
     for (i = 0; i < n; i++) {
-        nw->wname = pt->pname;
-#ifdef READONLYSTRINGS
-    	nw->wname = cp;
-        cp += strlen(cp) + 1;
-#endif /* READONLYSTRINGS */
+        /* The names are interned, so the table can be read-only */
+        nw->wname = intern(pt->pname + 1, strlen(pt->pname + 1), pt->pname[0]);
+        Dname(nw->wname)->nlist = &atl__env->forth;
         nw->wcode = pt->pcode;
         if (i != (n - 1)) {
             nw->wnext = nw + 1;
@@ -3403,415 +5255,3620 @@ void atl_primdef(struct primfcn *pt) {
         nw++;
         pt++;
     }
-}
-
-/*  PWALKBACK  --  Print walkback trace.  */
-
-void pwalkback(void) {
-    if (atl__env->enableWalkback && ((atl__env->currentWord != NULL) || (atl__env->walkbackPointer > atl__env->walkback))) {
-        fprintf(stderr, "walkback:\n");
-        if (atl__env->currentWord != NULL) {
-            fprintf(stderr, "   %s\n", atl__env->currentWord->wname + 1);
-        }
-        while (atl__env->walkbackPointer > atl__env->walkback) {
-            dictword *wb = *(--atl__env->walkbackPointer);
-            fprintf(stderr, "   %s\n", wb->wname + 1);
+    dictrehash(&atl__env->forth, atl__env->forth.lmask + 1 > Dicthash0 ? atl__env->forth.lmask + 1 : Dicthash0);
+#ifdef CLONE
+    if (atl__env->heap != NULL) {     /* For atl_clone to define again */
+        struct primfcn **pts = (struct primfcn **) alloc((unsigned int) ((atl__env->primTableCount + 1) * sizeof(struct primfcn *)));
+
+        if (atl__env->primTables != NULL) {
+            memcpy(pts, atl__env->primTables, (size_t) atl__env->primTableCount * sizeof(struct primfcn *));
+            free(atl__env->primTables);
         }
+        pts[atl__env->primTableCount++] = pf - n;
+        atl__env->primTables = pts;
+    }
+#endif
+#ifdef IMAGE
+    if (atl__env->heap != NULL) {
+        imagemark();		      /* Images start after these */
     }
+#endif
 }
 
-/*  TROUBLE  --  Common handler for serious errors.  */
+#if defined(SUPERINST) || defined(NATIVECODE) || defined(STACKEFFECT)
 
-void trouble(char *kind) {
-#ifdef MEMMESSAGE
-    fprintf(stderr, "\n%s.\n", kind);
+#ifdef NATIVECODE
+static Boolean jitcode(dictword *w);
 #endif
-#ifdef WALKBACK
-    pwalkback();
-#endif /* WALKBACK */
-    P_abort();			      /* Abort */
-    // reset all interpretation state */
-    atl__env->isIgnoringComment = state = atlFalsity;
-    atl__env->tokPendingForget = atl__env->tokPendingDefine = atl__env->tokPendingStringLiteral = atl__env->tokPendingTickMark = atl__env->tokPendingTickCompile = atlFalse;
-}
 
-/*  ATL_ERROR  --  Handle error detected by user-defined primitive.  */
+/*  ISBRANCH  --  Does word w take an ip-relative in-line offset?  */
 
-void atl_error(char *kind) {
-    trouble(kind);
-    atl__env->evalStatus = ATL_APPLICATION;       /* Signify application-detected error */
+static Boolean isbranch(dictword *w) {
+    stackitem s = (stackitem) w;
+
+    if (s == atl__env->s_branch || s == atl__env->s_qbranch ||
+        s == atl__env->s_xdo || s == atl__env->s_xqdo ||
+        s == atl__env->s_xloop || s == atl__env->s_pxloop) {
+        return atlTrue;
+    }
+#ifdef SUPERINST
+    if (s == atl__env->s_liteqqbranch) {
+        return atlTrue;
+    }
+#endif
+    return atlFalse;
 }
 
-/*  STAKOVER  --  Recover from stack overflow.	*/
+/*  INLINECELLS  --  Return the number of in-line operand cells that
+ follow word w in compiled code, or -1 if w is not a word we
+ can vouch for.  A word compiled by [ ... ] or COMPILE could
+ be anything, so unknown cells spoil the definition for
+ rewriting. */
 
-void stakover(void) {
-    trouble("Stack overflow");
-    atl__env->evalStatus = ATL_STACKOVER;
+static long inlinecells(dictword *w, dictword **ip) {
+    if (w == NULL) {
+        return -1;
+    }
+    if (w < atl__env->dictPrimitives || w >= atl__env->dictPrimitives + (ELEMENTS(primt) - 1)) {
+        /* The other words we vouch for all live in the heap, and a
+           cell there can be read as a word and judged by its code. */
+        if ((stackitem *) w < atl__env->heap || (stackitem *) (w + 1) > atl__env->heapAllocPtr ||
+            ((stackitem) w & (sizeof(stackitem) - 1)) != 0) {
+            return -1;
+        }
+        if (w == atl__env->createWord ||
+            w->wcode == P_nest || w->wcode == P_var || w->wcode == P_con ||
+            w->wcode == P_2con || w->wcode == P_arraysub || w->wcode == P_dodoes) {
+            return 0;
+        }
+#ifdef NATIVECODE
+        if (jitcode(w)) {
+            return 0;
+        }
+#endif
+        return -1;
+    }
+    if ((stackitem) w == atl__env->s_strlit || (stackitem) w == atl__env->s_dotparen ||
+        (stackitem) w == atl__env->s_abortq) {
+        return 1 + (stackitem) *ip;
+    }
+    if ((stackitem) w == atl__env->s_flit) {
+        return Realsize;
+    }
+#ifdef STACKEFFECT
+    if ((stackitem) w == atl__env->s_stackcheck) {
+        return 3;
+    }
+#endif
+#ifdef SUPERINST
+    if ((stackitem) w == atl__env->s_liteqqbranch) {
+        return 2;
+    }
+    if ((stackitem) w == atl__env->s_litplus) {
+        return 1;
+    }
+#endif
+    if ((stackitem) w == atl__env->s_lit || isbranch(w) || w->wcode == P_compile) {
+        return 1;
+    }
+    return 0;
 }
+#endif /* SUPERINST || NATIVECODE || STACKEFFECT */
 
-/*  STAKUNDER  --  Recover from stack underflow.  */
+#ifdef STACKEFFECT
 
-void stakunder(void) {
-    trouble("Stack underflow");
-    atl__env->evalStatus = ATL_STACKUNDER;
-}
+/*  PRIMWORD  --  Find the dictionary item primt made for code.  */
 
-/*  RSTAKOVER  --  Recover from return stack overflow.	*/
+static dictword *primword(codeptr code) {
+    size_t i;
 
-void rstakover(void) {
-    trouble("Return stack overflow");
-    atl__env->evalStatus = ATL_RSTACKOVER;
-}
+    for (i = 0; i < ELEMENTS(primt) - 1; i++) {
+        if (atl__env->dictPrimitives[i].wcode == code) {
+            return atl__env->dictPrimitives + i;
+        }
+    }
+    return NULL;
+}
+
+/*  STACKEFFECT  --  Work out how deep into the stack the just-completed
+ colon definition dw reaches, how far it grows it and what it leaves,
+ from effectt and the (CHECK) of the definitions it calls.  If every
+ path through it agrees, prefix the body with a (CHECK) of the whole
+ lot and use the unchecked variants of its primitives.  Otherwise the
+ definition is left alone, its primitives checking for themselves.
+ Moving the body up is safe as branch offsets are ip-relative, but not
+ if a literal points into it.  */
+
+#define EffStart    1                 // cell begins an instruction
+#define EffKnown    2                 // depth on reaching the cell is known
+
+static void stackeffect(dictword *dw) {
+    dictword **body = ((dictword **) dw) + Dictwordl;
+    dictword *prims = atl__env->dictPrimitives;
+    long n = (dictword **) atl__env->heapAllocPtr - body;
+    long i, c, t, d = 0, need = 0, grow = 0, net = 0, nloop = 0;
+    long *depth, *loops;
+    char *cell;
+    dictword **unchecked;
+    Boolean reached = atlTrue, returns = atlFalse;
+
+    if (atl__env->s_stackcheck == 0 ||
+        atl__env->heapAllocPtr + 4 > atl__env->heapTop) {
+        return;
+    }
+    depth = (long *) malloc((n + 1) * sizeof(long));
+    loops = (long *) malloc((n + 1) * sizeof(long));
+    cell = (char *) calloc(n + 1, 1);
+    unchecked = (dictword **) calloc(n + 1, sizeof(dictword *));
+    if (depth == NULL || loops == NULL || cell == NULL || unchecked == NULL) {
+        goto done;
+    }
 
-/*  RSTAKUNDER	--  Recover from return stack underflow.  */
+    for (i = 0; i < n; i += 1 + c) {
+        dictword *w = body[i];
 
-void rstakunder(void) {
-    trouble("Return stack underflow");
-    atl__env->evalStatus = ATL_RSTACKUNDER;
-}
+        cell[i] |= EffStart;
+        c = inlinecells(w, body + i + 1);
+        if (c < 0 || i + 1 + c > n) {
+            goto done;
+        }
+        if ((stackitem) w == atl__env->s_lit &&
+            (dictword **) body[i + 1] >= body && (dictword **) body[i + 1] <= body + n) {
+            goto done;
+        }
+    }
 
-// HEAPOVER
-// Recover from heap overflow.  Note that a heap
-// overflow does NOT wipe the heap; it's up to
-// the user to do this manually with FORGET or
-// some such.
-//
-void heapover(void) {
-    trouble("Heap overflow");
-    atl__env->evalStatus = ATL_HEAPOVER;
-}
+    // Follow the depth through the body.  Every way of reaching an
+    // instruction must agree on it; code nothing reaches is skipped.
 
-/*  BADPOINTER	--  Abort if bad pointer reference detected.  */
+#define Effjoin(k)  { if ((k) < 0 || (k) >= n || !(cell[k] & EffStart)) goto done; \
+                      if (cell[k] & EffKnown) { if (depth[k] != d) goto done; } \
+                      else if ((k) < i) goto done; \
+                      else { cell[k] |= EffKnown; depth[k] = d; } }
+#define Effuse(in, out)  { if ((in) - d > need) need = (in) - d; \
+                           d += (out) - (in); if (d > grow) grow = d; }
 
-void badpointer(void) {
-    trouble("Bad pointer");
-    atl__env->evalStatus = ATL_BADPOINTER;
-}
+    for (i = 0; i < n; i += 1 + c) {
+        dictword *w = body[i];
+        stackitem s = (stackitem) w;
 
-/*  NOTCOMP  --  Compiler word used outside definition.  */
+        c = inlinecells(w, body + i + 1);
+        if (cell[i] & EffKnown) {
+            if (reached && depth[i] != d) {
+                goto done;
+            }
+            d = depth[i];
+            reached = atlTrue;
+        } else if (!reached) {
+            continue;
+        }
+        cell[i] |= EffKnown;
+        depth[i] = d;
 
-void notcomp(void) {
-    trouble("Compiler word outside definition");
-    atl__env->evalStatus = ATL_NOTINDEF;
-}
+        if (s == atl__env->s_exit) {
+            if (returns && net != d) {
+                goto done;
+            }
+            returns = atlTrue;
+            net = d;
+            reached = atlFalse;
+        } else if (isbranch(w)) {
+            t = i + c + (stackitem) body[i + c];
+            if (s == atl__env->s_xdo || s == atl__env->s_xqdo) {
+                Effuse(2, 0);
+                if (s == atl__env->s_xqdo) {
+                    Effjoin(t);
+                }
+                loops[nloop++] = t;
+            } else {
+                if (s == atl__env->s_xloop || s == atl__env->s_pxloop) {
+                    if (nloop == 0) {
+                        goto done;
+                    }
+                    nloop--;
+                }
+                if (s != atl__env->s_branch && s != atl__env->s_xloop) {
+                    Effuse(1, 0);
+                }
+                Effjoin(t);
+                if (s == atl__env->s_branch) {
+                    reached = atlFalse;
+                }
+            }
+        } else if (w->wcode == P_leave) {
+            if (nloop == 0) {
+                goto done;
+            }
+            Effjoin(loops[nloop - 1]);
+            reached = atlFalse;
+        } else if (w >= prims && w < prims + (ELEMENTS(primt) - 1)) {
+            size_t k;
 
-/*  DIVZERO  --  Attempt to divide by zero.  */
+            for (k = 0; k < ELEMENTS(effectt) && effectt[k].pcode != w->wcode; k++) {
+            }
+            if (k == ELEMENTS(effectt)) {
+                goto done;
+            }
+            Effuse(effectt[k].pin, effectt[k].pout);
+            if (effectt[k].unchecked != NULL &&
+                (unchecked[i] = primword(effectt[k].unchecked)) == NULL) {
+                goto done;
+            }
+        } else if (w->wcode == P_var || w->wcode == P_con) {
+            Effuse(0, 1);
+        } else if (w->wcode == P_2con) {
+            Effuse(0, 2);
+        } else if (w->wcode == P_nest && w != dw &&
+                   (stackitem) ((dictword **) w)[Dictwordl] == atl__env->s_stackcheck) {
+            // It checks for itself on entry, so only what it leaves
+            // matters here.
+            Effuse(0, (stackitem) ((dictword **) w)[Dictwordl + 3]);
+        } else {
+            goto done;
+        }
+    }
+    if (nloop != 0) {
+        goto done;
+    }
+#undef Effjoin
+#undef Effuse
 
-void divzero(void) {
-    trouble("Divide by zero");
-    atl__env->evalStatus = ATL_DIVZERO;
-}
+    for (i = 0; i < n; i++) {
+        if (unchecked[i] != NULL) {
+            body[i] = unchecked[i];
+        }
+    }
+    Msh(4);
+    memmove(body + 4, body, n * sizeof(dictword *));
+    body[0] = (dictword *) atl__env->s_stackcheck;
+    body[1] = (dictword *) need;
+    body[2] = (dictword *) grow;
+    body[3] = (dictword *) net;
+    atl__env->heapAllocPtr += 4;
+
+done:
+    free(depth);
+    free(loops);
+    free(cell);
+    free(unchecked);
+}
+#endif /* STACKEFFECT */
+
+#ifdef SUPERINST
+
+/*  FUSE  --  Rewrite the body of a just-completed colon definition,
+ replacing frequent sequences of primitives with the
+ superinstructions enabled in fuseMask.  The body is
+ compacted in place and every branch offset recomputed,
+ so the definition is left alone if a literal points into
+ it, and a sequence is not fused if a branch lands inside
+ it.  */
+
+#define FuseStart   1                 // cell begins an instruction
+#define FuseLanding 2                 // cell is a branch target
+
+static void fuse(dictword *dw) {
+    dictword **body = ((dictword **) dw) + Dictwordl;
+    long n = (dictword **) atl__env->heapAllocPtr - body;
+    long i, j, c, nfix = 0;
+    long *newpos, *target, *fix;
+    char *cell;
+
+    if (n <= 1 || atl__env->fuseMask == 0) {
+        return;
+    }
+    newpos = (long *) malloc((n + 1) * sizeof(long));
+    target = (long *) malloc(n * sizeof(long));
+    fix = (long *) malloc(n * sizeof(long));
+    cell = (char *) calloc(n + 1, 1);
+    if (newpos == NULL || target == NULL || fix == NULL || cell == NULL) {
+        goto done;
+    }
 
-/*  EXWORD  --	Execute a word (and any sub-words it may invoke). */
+    // Walk the body once to find where instructions start and where
+    // branches go.  Give up on anything we can't account for.
 
-void exword(dictword *wp) {
-    atl__env->currentWord = wp;
-#ifdef TRACE
-    if (atl__env->enableTrace) {
-        fprintf(stderr, "\ntrace: %s ", atl__env->currentWord->wname + 1);
+    for (i = 0; i < n; i += 1 + c) {
+        dictword *w = body[i];
+
+        cell[i] |= FuseStart;
+        c = inlinecells(w, body + i + 1);
+        if (c < 0 || i + 1 + c > n) {
+            goto done;
+        }
+        if (isbranch(w)) {
+            long o = (stackitem) w == atl__env->s_liteqqbranch ? i + 2 : i + 1;
+
+            target[o] = o + (stackitem) body[o];
+            if (target[o] < 0 || target[o] > n) {
+                goto done;
+            }
+            cell[target[o]] |= FuseLanding;
+        }
+        if ((stackitem) w == atl__env->s_lit &&
+            (dictword **) body[i + 1] >= body && (dictword **) body[i + 1] <= body + n) {
+            goto done;
+        }
     }
-#endif /* TRACE */
-    (*atl__env->currentWord->wcode)();	      /* Execute the first word */
-    while (atl__env->ip != NULL) {
-#ifdef BREAK
-        if (atl__env->asyncBreakReceived) {		      /* Did we receive a break signal */
-            trouble("Break signal");
-            atl__env->evalStatus = ATL_BREAK;
-            break;
+    for (i = 0; i < n; i++) {
+        if (cell[i] == FuseLanding) {
+            goto done;                  // branch into the middle of an instruction
         }
-#endif /* BREAK */
-        atl__env->currentWord = *atl__env->ip++;
-#ifdef TRACE
-        if (atl__env->enableTrace) {
-            fprintf(stderr, "\ntrace: %s ", atl__env->currentWord->wname + 1);
+    }
+
+#define Fusable(k, code)    ((k) < n && cell[k] == FuseStart && body[k]->wcode == (code))
+#define Rule(r)             (atl__env->fuseMask & (1L << (r)))
+
+    for (i = j = 0; i < n; ) {
+        dictword *w = body[i];
+        long k, m = 1;
+
+        c = inlinecells(w, body + i + 1);
+        if ((stackitem) w == atl__env->s_lit && Rule(FuseLitEqQbranch) &&
+            Fusable(i + 2, P_equal) && i + 3 < n && cell[i + 3] == FuseStart &&
+            (stackitem) body[i + 3] == atl__env->s_qbranch) {
+            body[j] = (dictword *) atl__env->s_liteqqbranch;
+            body[j + 1] = body[i + 1];
+            fix[nfix++] = j + 2;
+            body[j + 2] = (dictword *) target[i + 4];
+            m = 5;
+            c = 2;
+        } else if ((stackitem) w == atl__env->s_lit && Rule(FuseLitPlus) && Fusable(i + 2, P_plus)) {
+            body[j] = (dictword *) atl__env->s_litplus;
+            body[j + 1] = body[i + 1];
+            m = 3;
+            c = 1;
+        } else if (w->wcode == P_dup && Rule(FuseDupAt) && Fusable(i + 1, P_at)) {
+            body[j] = (dictword *) atl__env->s_dupat;
+            m = 2;
+            c = 0;
+        } else if (w->wcode == P_over && Rule(FuseOverOver) && Fusable(i + 1, P_over)) {
+            body[j] = (dictword *) atl__env->s_2dup;
+            m = 2;
+            c = 0;
+        } else if (w->wcode == P_i && Rule(FuseIPlus) && Fusable(i + 1, P_plus)) {
+            body[j] = (dictword *) atl__env->s_iplus;
+            m = 2;
+            c = 0;
+        } else if (w->wcode == P_at && Rule(FuseAtPlus) && Fusable(i + 1, P_plus)) {
+            body[j] = (dictword *) atl__env->s_atplus;
+            m = 2;
+            c = 0;
+        } else {
+            for (k = 0; k <= c; k++) {
+                body[j + k] = body[i + k];
+            }
+            if (isbranch(w)) {
+                fix[nfix++] = j + c;
+                body[j + c] = (dictword *) target[i + c];
+            }
+            m = 1 + c;
         }
-#endif /* TRACE */
-        (*atl__env->currentWord->wcode)();	      /* Execute the next word */
+        for (k = 0; k < m; k++) {
+            newpos[i + k] = j;
+        }
+        i += m;
+        j += 1 + c;
     }
-    atl__env->currentWord = NULL;
-}
+    newpos[n] = j;
 
-// ATL_INIT
-// Initialise the ATLAST system.  The dynamic storage areas
-// are allocated unless the caller has preallocated buffers
-// for them and stored the addresses into the respective
-// pointers.  In either case, the storage management
-// pointers are initialised to the correct addresses.  If
-// the caller preallocates the buffers, it's up to him to
-// ensure that the length allocated agrees with the lengths
-// given by the atl_... cells.
-//
-void atl_init(void) {
-    if (atl__env->dict == NULL) {
-        atl_primdef(primt);	      /* Define primitive words */
-        atl__env->dictFirstProtectedEntry = atl__env->dict;	      /* Set protected mark in dictionary */
+#undef Fusable
+#undef Rule
 
-        /* Look up compiler-referenced words in the new dictionary and
-         save their compile addresses in static variables. */
+    // Branch operands were parked holding their old target index;
+    // turn them back into offsets within the compacted body.
 
-#define Cconst(cell, name)  cell = (stackitem) lookup(name); if(cell==0)abort()
-        Cconst(atl__env->s_exit     , "EXIT");
-        Cconst(atl__env->s_lit      , "(LIT)");
-        Cconst(atl__env->s_flit     , "(FLIT)");
-        Cconst(atl__env->s_strlit   , "(STRLIT)");
-        Cconst(atl__env->s_dotparen , ".(");
-        Cconst(atl__env->s_qbranch  , "?BRANCH");
-        Cconst(atl__env->s_branch   , "BRANCH");
-        Cconst(atl__env->s_xdo      , "(XDO)");
-        Cconst(atl__env->s_xqdo     , "(X?DO)");
-        Cconst(atl__env->s_xloop    , "(XLOOP)");
-        Cconst(atl__env->s_pxloop   , "(+XLOOP)");
-        Cconst(atl__env->s_abortq   , "ABORT\"");
-#undef Cconst
+    for (i = 0; i < nfix; i++) {
+        body[fix[i]] = (dictword *) (newpos[(stackitem) body[fix[i]]] - fix[i]);
+    }
+    atl__env->heapAllocPtr = (stackitem *) (body + j);
 
-        if (atl__env->stack == NULL) {	      /* Allocate stack if needed */
-            atl__env->stack = (stackitem *) alloc(((unsigned int) atl__env->stkLength) * sizeof(stackitem));
+done:
+    free(newpos);
+    free(target);
+    free(fix);
+    free(cell);
+}
+
+#undef FuseStart
+#undef FuseLanding
+
+/*  FUSERECORD  --  Count the candidate sequences ending in word w.  */
+
+static void fuserecord(dictword *w) {
+    codeptr c = w->wcode, c1 = atl__env->fuseHistory[0];
+
+    if (c1 == P_dolit) {
+        if (c == P_plus) {
+            atl__env->fuseCounts[FuseLitPlus]++;
         }
-        atl__env->stk = atl__env->stkBottom = atl__env->stack;
-#ifdef MEMSTAT
-        atl__env->stkMaxExtent = atl__env->stack;
+    } else if (c1 == P_equal) {
+        if (c == P_qbranch && atl__env->fuseHistory[1] == P_dolit) {
+            atl__env->fuseCounts[FuseLitEqQbranch]++;
+        }
+    } else if (c1 == P_dup) {
+        if (c == P_at) {
+            atl__env->fuseCounts[FuseDupAt]++;
+        }
+    } else if (c1 == P_over) {
+        if (c == P_over) {
+            atl__env->fuseCounts[FuseOverOver]++;
+        }
+    } else if (c1 == P_i) {
+        if (c == P_plus) {
+            atl__env->fuseCounts[FuseIPlus]++;
+        }
+    } else if (c1 == P_at) {
+        if (c == P_plus) {
+            atl__env->fuseCounts[FuseAtPlus]++;
+        }
+    }
+    atl__env->fuseHistory[1] = c1;
+    atl__env->fuseHistory[0] = c;
+}
+#endif /* SUPERINST */
+
+#ifdef NATIVECODE
+
+/*  Native code translation of colon definitions (x86-64).
+
+    JIT translates the body of a colon definition into machine code
+    when ; completes it, and installs the code as the word's wcode.
+    The code does what P_nest and the threaded body would: it pushes
+    ip on the return stack, runs the body, and pops ip at EXIT.
+
+    While it runs, rbx holds the stack pointer, r13 the return stack
+    pointer and r12 atl__env.  Common primitives are expanded in line
+    from templates, and branches and loops become native jumps.  Any
+    other word is run by writing the state back, pointing ip just past
+    the word in the threaded body (which is left intact), and calling
+    its C code.  A template whose stack or heap check fails does the
+    same, so errors are reported exactly as the threaded code would
+    report them.  If ip comes back NULL the word was aborted, and we
+    return at once.
+
+    SUBTHREAD uses the same translator but expands no primitives in
+    line: every word becomes a native call to its C code, while
+    literals, branches and loops are still compiled directly.  */
+
+#if !defined(__x86_64__) || !defined(__GNUC__)
+#error "JIT and SUBTHREAD require x86-64 and gcc or clang"
 #endif
-        atl__env->stkTop = atl__env->stack + atl__env->stkLength;
-        if (atl__env->rstack == NULL) {	      /* Allocate return stack if needed */
-            atl__env->rstack = (dictword ***) alloc(((unsigned int) atl__env->rsLength) * sizeof(dictword **));
+
+#define Jrax    0                     // Registers
+#define Jrcx    1
+#define Jrdx    2
+#define Jrbx    3
+#define Jrdi    7
+#define Jr12    12
+#define Jr13    13
+
+#define Jcb     0x2                   // Condition codes
+#define Jcae    0x3
+#define Jce     0x4
+#define Jcne    0x5
+#define Jcbe    0x6
+#define Jca     0x7
+#define Jcl     0xC
+#define Jcge    0xD
+#define Jcle    0xE
+#define Jcg     0xF
+
+#define Jexit   -1                    // Fixup targets other than instructions
+#define Jbail   -2
+#define Jbreak  -3
+
+#define Joff(f) ((long) offsetof(atlenv, f))
+
+struct jitfix {
+    unsigned char *at;                // rel32 field to patch
+    long to;                          // instruction index or Jexit, Jbail, Jbreak
+};
+
+static unsigned char *jitp;           // Code emission pointer
+static struct jitfix *jitfixes;       // Jumps to labels
+static long jitnfix;
+static struct jitfix *jitslows;       // Failed checks, by instruction
+static long jitnslow;
+static long jiti;                     // Instruction being translated
+static dictword **jitbody;            // Threaded body being translated
+
+/*  JITCODE  --  Is the word's wcode translated code?  */
+
+static Boolean jitcode(dictword *w) {
+    unsigned char *c = (unsigned char *) w->wcode;
+
+    return (atl__env->jitArena != NULL && c >= atl__env->jitArena && c < atl__env->jitPtr) ? atlTrue : atlFalse;
+}
+
+/*  JITFORGET  --  Release the code of a word being forgotten.  Words
+ are forgotten newest first, and their code was allocated
+ in the same order.  */
+
+static void jitforget(dictword *w) {
+    if (jitcode(w)) {
+        atl__env->jitPtr = (unsigned char *) w->wcode;
+    }
+}
+
+/*  JITEXEC  --  Run atl__env->currentWord to completion from native
+ code.  ip is restored unless the word was aborted.  */
+
+static void jitexec(void) {
+    dictword **ip = atl__env->ip;
+    dictword ***rs = atl__env->rs;
+
+    atl__env->ip = NULL;
+    atl__env->execNesting++;
+    exword(atl__env->currentWord);
+    atl__env->execNesting--;
+    if (atl__env->rs == rs) {
+        atl__env->ip = ip;
+    }
+}
+
+/*  JITTHREAD  --  Run a translated word's threaded body instead, so
+ that tracing and profiling see every word it executes.  */
+
+static void jitthread(dictword *w) {
+    dictword **ip = atl__env->ip, **body = ((dictword **) w) + Dictwordl;
+    dictword ***rs;
+
+    Rso(1);
+#ifdef WALKBACK
+    if (atl__env->enableWalkback) {
+        *atl__env->walkbackPointer++ = w;
+    }
+#endif
+    Rpush = NULL;                     /* EXIT of the body ends exword */
+    rs = atl__env->rs;
+    atl__env->ip = body + 1;
+    atl__env->execNesting++;
+    exword(*body);
+    atl__env->execNesting--;
+    if (atl__env->rs == rs - 1) {
+        atl__env->ip = ip;
+    }
+}
+
+#ifdef BREAK
+static void jitbreak(void) {
+    trouble("Break signal");
+    atl__env->evalStatus = ATL_BREAK;
+}
+#endif /* BREAK */
+
+/*  JITFUEL  --  The budget ran out at a safe point in translated code,
+ with ip at the matching place in the threaded body.  */
+
+static void jitfuel(void) {
+    (void) safepoint();
+}
+
+/*  Instruction encoding  */
+
+static void jb(int b) {
+    if (jitp < atl__env->jitTop) {
+        *jitp = (unsigned char) b;
+    }
+    jitp++;
+}
+
+static void j32(long v) {
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        jb((int) ((v >> (8 * i)) & 0xFF));
+    }
+}
+
+static void j64(stackitem v) {
+    j32(v);
+    j32(v >> 32);
+}
+
+static void jrex(int w, int reg, int rm) {
+    int rex = 0x40 | (w << 3) | ((reg >> 3) << 2) | (rm >> 3);
+
+    if (rex != 0x40) {
+        jb(rex);
+    }
+}
+
+static void jopcode(int op) {
+    if (op > 0xFF) {
+        jb(op >> 8);
+    }
+    jb(op & 0xFF);
+}
+
+/* op reg, [base + disp] */
+static void jm(int w, int op, int reg, int base, long disp) {
+    jrex(w, reg, base);
+    jopcode(op);
+    jb(0x80 | ((reg & 7) << 3) | (base & 7));
+    if ((base & 7) == 4) {
+        jb(0x24);
+    }
+    j32(disp);
+}
+
+/* op reg, rm */
+static void jr(int w, int op, int reg, int rm) {
+    jrex(w, reg, rm);
+    jopcode(op);
+    jb(0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+static void jmovi(int reg, stackitem v) {
+    jrex(1, 0, reg);
+    jb(0xB8 + (reg & 7));
+    j64(v);
+}
+
+static void jaddi(int reg, long v) {
+    jr(1, 0x81, 0, reg);
+    j32(v);
+}
+
+static void jsubi(int reg, long v) {
+    jr(1, 0x81, 5, reg);
+    j32(v);
+}
+
+static void jld(int reg, int base, long disp) {
+    jm(1, 0x8B, reg, base, disp);
+}
+
+static void jst(int reg, int base, long disp) {
+    jm(1, 0x89, reg, base, disp);
+}
+
+/* cmp [r12 + disp], 0 for a flag of the given size */
+static void jflag(long disp, size_t size) {
+    jm(size == 8, 0x81, 7, Jr12, disp);
+    j32(0);
+}
+
+static unsigned char *jjcc(int cc) {
+    jb(0x0F);
+    jb(0x80 | cc);
+    j32(0);
+    return jitp - 4;
+}
+
+static unsigned char *jjmp(void) {
+    jb(0xE9);
+    j32(0);
+    return jitp - 4;
+}
+
+static void jpatch(unsigned char *at, unsigned char *to) {
+    long d = (long) (to - (at + 4));
+    int i;
+
+    if (at + 4 <= atl__env->jitTop) {
+        for (i = 0; i < 4; i++) {
+            at[i] = (unsigned char) ((d >> (8 * i)) & 0xFF);
         }
-        atl__env->rs = atl__env->rsBottom = atl__env->rstack;
+    }
+}
+
+static void jfix(unsigned char *at, long to) {
+    jitfixes[jitnfix].at = at;
+    jitfixes[jitnfix].to = to;
+    jitnfix++;
+}
+
+static void jret(void) {
+    jb(0x41); jb(0x5D);               // pop r13
+    jb(0x41); jb(0x5C);               // pop r12
+    jb(0x5B);                         // pop rbx
+    jb(0xC3);                         // ret
+}
+
+/* Push rax on the data stack */
+static void jpush(void) {
+    jst(Jrax, Jrbx, 0);
+    jaddi(Jrbx, sizeof(stackitem));
+}
+
+/* Flags from a truth test become atlTruth or atlFalsity in rax */
+static void jtruth(int cc) {
+    jb(0x0F); jb(0x90 | cc); jb(0xC0);        // setcc al
+    jr(0, 0x0FB6, Jrax, Jrax);                // movzx eax, al
+    jr(1, 0xF7, 3, Jrax);                     // neg rax
+}
+
+/*  Stack and heap checks.  A failed check runs the instruction's C
+ code instead, which reports the error.  */
+
+#ifdef STACKFLOOR
+static void jcheck(int reg, long n, long limit, int cc) {
+    jm(1, 0x8D, Jrax, reg, n * (long) sizeof(stackitem));     // lea rax, [reg + n]
+    jm(1, 0x3B, Jrax, Jr12, limit);
+    jitslows[jitnslow].at = jjcc(cc);
+    jitslows[jitnslow].to = jiti;
+    jitnslow++;
+}
+
+#define Jsl(n)      jcheck(Jrbx, -(n), Joff(stack), Jcb)
+#define Jrsl(n)     jcheck(Jr13, -(n), Joff(rstack), Jcb)
+#else
+#define Jsl(n)
+#define Jrsl(n)
+#endif /* STACKFLOOR */
+
+#ifdef STACKCHECK
 #ifdef MEMSTAT
-        atl__env->rsMaxExtent = atl__env->rstack;
+#define Jstklimit   Joff(stkMaxExtent)    // Past the high-water mark, C updates it
+#define Jrslimit    Joff(rsMaxExtent)
+#else
+#define Jstklimit   Joff(stkTop)
+#define Jrslimit    Joff(rsTop)
 #endif
-        atl__env->rsTop = atl__env->rstack + atl__env->rsLength;
+#define Jso(n)      jcheck(Jrbx, (n), Jstklimit, Jca)
+#define Jrso(n)     jcheck(Jr13, (n), Jrslimit, Jca)
+#else
+#define Jso(n)
+#define Jrso(n)
+#endif /* STACKCHECK */
+
+#ifdef NOMEMCHECK
+#define Jhpc(r)
+#else
+static void jhpc(int reg) {
+    jm(1, 0x3B, reg, Jr12, Joff(heapBottom));
+    jitslows[jitnslow].at = jjcc(Jcb);
+    jitslows[jitnslow].to = jiti;
+    jitnslow++;
+    jm(1, 0x3B, reg, Jr12, Joff(heapTop));
+    jitslows[jitnslow].at = jjcc(Jcae);
+    jitslows[jitnslow].to = jiti;
+    jitnslow++;
+}
+
+#define Jhpc(r)     jhpc(r)
+#endif /* NOMEMCHECK */
+
+/*  JCALL  --  Call fn with the state written back.  w, if not NULL,
+ becomes currentWord, and ip is set to resume, if not NULL.
+ Leaves the new ip in rax.  */
+
+static void jcall(dictword *w, codeptr fn, dictword **resume) {
+    jst(Jrbx, Jr12, Joff(stk));
+    jst(Jr13, Jr12, Joff(rs));
+    if (w != NULL) {
+        jmovi(Jrax, (stackitem) w);
+        jst(Jrax, Jr12, Joff(currentWord));
+    }
+    if (resume != NULL) {
+        jmovi(Jrax, (stackitem) resume);
+        jst(Jrax, Jr12, Joff(ip));
+    }
+    jmovi(Jrax, (stackitem) fn);
+    jb(0xFF); jb(0xD0);                       // call rax
+    jld(Jrbx, Jr12, Joff(stk));
+    jld(Jr13, Jr12, Joff(rs));
+    jld(Jrax, Jr12, Joff(ip));
+    jr(1, 0x85, Jrax, Jrax);                  // test rax, rax
+    jfix(jjcc(Jce), Jbail);
+}
+
+/*  JPOLL  --  A safe point on the way to instruction t.  Poll for a
+ break, and charge the atl_exec() budget, suspending at t in the
+ threaded body if it has run out (see Bpoll).  */
+
+static void jpoll(long t) {
+    unsigned char *unlimited, *left;
+
+#ifdef BREAK
+    jflag(Joff(asyncBreakReceived), sizeof(atl__env->asyncBreakReceived));
+    jfix(jjcc(Jcne), Jbreak);
+#endif
+    jflag(Joff(fuel), sizeof(atl__env->fuel));
+    unlimited = jjcc(Jce);
+    jm(1, 0xFF, 1, Jr12, Joff(fuel));         // dec qword [fuel]
+    left = jjcc(Jcne);
+    jcall(NULL, jitfuel, jitbody + t);
+    jpatch(unlimited, jitp);
+    jpatch(left, jitp);
+}
+
+/* Jump to instruction t, through a safe point if it is a loop */
+static void jgoto(long t) {
+    if (t <= jiti) {
+        jpoll(t);
+    }
+    jfix(jjmp(), t);
+}
+
+/*  JIT  --  Translate the colon definition dw.  Primitives are
+ expanded in line if expand is true and called otherwise.  Leaves it
+ threaded if it uses a word we can't follow, such as DOES>.  */
+
+static void jit(dictword *dw, Boolean expand) {
+    dictword **body = ((dictword **) dw) + Dictwordl;
+    dictword *prims = atl__env->dictPrimitives;
+    long n = (dictword **) atl__env->heapAllocPtr - body;
+    long i, c, t, nloop = 0;
+    long *aux = NULL, *loops = NULL;
+    char *start = NULL;
+    unsigned char **label = NULL, *code, *bail, *brk = NULL, *p;
+
+    if (atl__env->jitArena == NULL) {
+        void *a = mmap(NULL, (size_t) atl__env->jitLength, PROT_READ | PROT_WRITE | PROT_EXEC,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (a == MAP_FAILED) {
+            atl__env->enableJit = atl__env->enableSubthread = atlFalsity;
+            return;
+        }
+        atl__env->jitArena = atl__env->jitPtr = (unsigned char *) a;
+        atl__env->jitTop = atl__env->jitArena + atl__env->jitLength;
+    }
+
+    aux = (long *) malloc((n + 1) * sizeof(long));
+    loops = (long *) malloc((n + 1) * sizeof(long));
+    start = (char *) calloc(n + 1, 1);
+    label = (unsigned char **) malloc((n + 1) * sizeof(unsigned char *));
+    jitfixes = (struct jitfix *) malloc(8 * (n + 4) * sizeof(struct jitfix));
+    jitslows = (struct jitfix *) malloc(8 * (n + 4) * sizeof(struct jitfix));
+    if (aux == NULL || loops == NULL || start == NULL || label == NULL ||
+        jitfixes == NULL || jitslows == NULL) {
+        goto done;
+    }
+
+    // Find the instructions, branch targets and the loop each LEAVE
+    // leaves.  Loops nest lexically, so a stack of open DOs finds it.
+
+    for (i = 0; i < n; i += 1 + c) {
+        dictword *w = body[i];
+
+        start[i] = 1;
+        c = inlinecells(w, body + i + 1);
+        if (c < 0 || i + 1 + c > n) {
+            goto done;
+        }
+        if (w >= prims && w < prims + (ELEMENTS(primt) - 1) &&
+            (w->wcode == P_nest || w->wcode == P_does || w->wcode == P_dodoes)) {
+            goto done;
+        }
+        if (isbranch(w)) {
+            long o = i + c;           // the offset is the last operand
+
+            aux[i] = o + (stackitem) body[o];
+            if (aux[i] < 0 || aux[i] > n) {
+                goto done;
+            }
+        }
+        if ((stackitem) w == atl__env->s_xdo || (stackitem) w == atl__env->s_xqdo) {
+            loops[nloop++] = aux[i];
+        } else if ((stackitem) w == atl__env->s_xloop || (stackitem) w == atl__env->s_pxloop) {
+            if (nloop == 0) {
+                goto done;
+            }
+            nloop--;
+        } else if (w->wcode == P_leave) {
+            if (nloop == 0) {
+                goto done;
+            }
+            aux[i] = loops[nloop - 1];
+        }
+    }
+    start[n] = 1;
+    for (i = 0; i < n; i += 1 + inlinecells(body[i], body + i + 1)) {
+        if ((isbranch(body[i]) || body[i]->wcode == P_leave) && !start[aux[i]]) {
+            goto done;
+        }
+    }
+
+    code = jitp = atl__env->jitPtr;
+    jitbody = body;
+    jitnfix = jitnslow = 0;
+
+    // Prologue.  Save the registers we use, then do what P_nest does.
+
+    jb(0x53);                         // push rbx
+    jb(0x41); jb(0x54);               // push r12
+    jb(0x41); jb(0x55);               // push r13
+    jmovi(Jr12, (stackitem) &atl__env);
+    jld(Jr12, Jr12, 0);
+    {
+        unsigned char *nestslow = NULL, *go, *resumed = NULL;
+#if defined(TRACE) || defined(SUPERINST)
+        unsigned char *thread;
+
+        jflag(Joff(instrumented), sizeof(atl__env->instrumented));
+        thread = jjcc(Jcne);
+#endif
+        jld(Jrbx, Jr12, Joff(stk));
+        jld(Jr13, Jr12, Joff(rs));
+#ifdef STACKCHECK
+        jm(1, 0x8D, Jrax, Jr13, sizeof(stackitem));
+        jm(1, 0x3B, Jrax, Jr12, Jrslimit);
+        nestslow = jjcc(Jca);
+#endif
+        jld(Jrax, Jr12, Joff(ip));
+        jst(Jrax, Jr13, 0);
+        jaddi(Jr13, sizeof(stackitem));
 #ifdef WALKBACK
-        if (atl__env->walkback == NULL) {
-            atl__env->walkback = (dictword **) alloc(((unsigned int) atl__env->rsLength) * sizeof(dictword *));
+        jflag(Joff(enableWalkback), sizeof(atl__env->enableWalkback));
+        p = jjcc(Jce);
+        jld(Jrax, Jr12, Joff(walkbackPointer));
+        jmovi(Jrcx, (stackitem) dw);
+        jst(Jrcx, Jrax, 0);
+        jaddi(Jrax, sizeof(dictword *));
+        jst(Jrax, Jr12, Joff(walkbackPointer));
+        jpatch(p, jitp);
+#endif
+        go = jjmp();
+        if (nestslow != NULL) {
+            jpatch(nestslow, jitp);
+            jcall(dw, P_nest, NULL);
+            resumed = jjmp();
         }
-        atl__env->walkbackPointer = atl__env->walkback;
+#if defined(TRACE) || defined(SUPERINST)
+        jpatch(thread, jitp);
+        jmovi(Jrdi, (stackitem) dw);
+        jmovi(Jrax, (stackitem) jitthread);
+        jb(0xFF); jb(0xD0);           // call rax
+        jret();
 #endif
-        if (atl__env->heap == NULL) {
+        jpatch(go, jitp);
+        if (resumed != NULL) {
+            jpatch(resumed, jitp);
+        }
+        jpoll(0);                     // Like P_nest, a safe point
+    }
+
+    // Body
+
+    for (i = 0; i < n; i += 1 + c) {
+        dictword *w = body[i];
+        codeptr wc = w->wcode;
+        Boolean isprim = (w >= prims && w < prims + (ELEMENTS(primt) - 1)) ? atlTrue : atlFalse;
+        Boolean inl = expand && isprim;
+        stackitem s = (stackitem) w;
+
+        jiti = i;
+        label[i] = jitp;
+        c = inlinecells(w, body + i + 1);
+        t = aux[i];
+
+        if (s == atl__env->s_lit) {
+            Jso(1);
+            jmovi(Jrax, (stackitem) body[i + 1]);
+            jpush();
+        } else if (s == atl__env->s_exit) {
+            if (i + 1 < n) {
+                jfix(jjmp(), Jexit);
+            }
+        } else if (s == atl__env->s_branch) {
+            jgoto(t);
+        } else if (s == atl__env->s_qbranch) {
+            Jsl(1);
+            jld(Jrax, Jrbx, -8);
+            jsubi(Jrbx, 8);
+            jr(1, 0x85, Jrax, Jrax);
+            if (t <= i) {
+                p = jjcc(Jcne);
+                jgoto(t);
+                jpatch(p, jitp);
+            } else {
+                jfix(jjcc(Jce), t);
+            }
+#ifdef SUPERINST
+        } else if (s == atl__env->s_liteqqbranch) {
+            Jsl(1);
+            jld(Jrax, Jrbx, -8);
+            jsubi(Jrbx, 8);
+            jmovi(Jrcx, (stackitem) body[i + 1]);
+            jr(1, 0x39, Jrcx, Jrax);          // cmp rax, rcx
+            if (t <= i) {
+                p = jjcc(Jce);
+                jgoto(t);
+                jpatch(p, jitp);
+            } else {
+                jfix(jjcc(Jcne), t);
+            }
+        } else if (s == atl__env->s_litplus) {
+            Jsl(1);
+            jmovi(Jrax, (stackitem) body[i + 1]);
+            jm(1, 0x01, Jrax, Jrbx, -8);      // add [rbx-8], rax
+#endif
+        } else if (s == atl__env->s_xdo || s == atl__env->s_xqdo) {
+            Jsl(2);
+            if (s == atl__env->s_xqdo) {
+                jld(Jrax, Jrbx, -8);
+                jm(1, 0x3B, Jrax, Jrbx, -16);
+                p = jjcc(Jcne);
+                jsubi(Jrbx, 16);
+                jfix(jjmp(), t);
+                jpatch(p, jitp);
+            }
+            Jrso(3);
+            jmovi(Jrax, (stackitem) (body + t));
+            jst(Jrax, Jr13, 0);               // exit address for LEAVE
+            jld(Jrax, Jrbx, -16);
+            jst(Jrax, Jr13, 8);               // limit
+            jld(Jrax, Jrbx, -8);
+            jst(Jrax, Jr13, 16);              // index
+            jaddi(Jr13, 24);
+            jsubi(Jrbx, 16);
+        } else if (s == atl__env->s_xloop) {
+            Jrsl(3);
+            jld(Jrax, Jr13, -8);
+            jaddi(Jrax, 1);
+            jst(Jrax, Jr13, -8);
+            jm(1, 0x3B, Jrax, Jr13, -16);
+            p = jjcc(Jce);
+            jgoto(t);
+            jpatch(p, jitp);
+            jsubi(Jr13, 24);
+        } else if (s == atl__env->s_pxloop) {
+            unsigned char *more, *out;
+
+            Jsl(1);
+            Jrsl(3);
+            jld(Jrax, Jrbx, -8);
+            jsubi(Jrbx, 8);
+            jld(Jrcx, Jr13, -8);
+            jr(1, 0x01, Jrcx, Jrax);          // rax = new index
+            jld(Jrdx, Jr13, -16);
+            jr(1, 0x39, Jrdx, Jrax);          // cmp new, limit
+            more = jjcc(Jcl);
+            jr(1, 0x39, Jrdx, Jrcx);          // cmp old, limit
+            out = jjcc(Jcl);
+            jpatch(more, jitp);
+            jst(Jrax, Jr13, -8);
+            jgoto(t);
+            jpatch(out, jitp);
+            jsubi(Jr13, 24);
+        } else if (isprim && wc == P_leave) {
+            Jrsl(3);
+            jsubi(Jr13, 24);
+            jfix(jjmp(), t);
+        } else if (isprim && wc == P_execute) {
+            Jsl(1);
+            jld(Jrax, Jrbx, -8);
+            jsubi(Jrbx, 8);
+            jst(Jrax, Jr12, Joff(currentWord));
+            jcall(NULL, jitexec, body + i + 1);
+        } else if (inl && (wc == P_plus || wc == P_minus || wc == P_and || wc == P_or || wc == P_xor)) {
+            Jsl(2);
+            jld(Jrax, Jrbx, -8);
+            jm(1, wc == P_plus ? 0x01 : wc == P_minus ? 0x29 : wc == P_and ? 0x21 : wc == P_or ? 0x09 : 0x31,
+               Jrax, Jrbx, -16);
+            jsubi(Jrbx, 8);
+        } else if (inl && wc == P_times) {
+            Jsl(2);
+            jld(Jrax, Jrbx, -16);
+            jm(1, 0x0FAF, Jrax, Jrbx, -8);    // imul rax, [rbx-8]
+            jst(Jrax, Jrbx, -16);
+            jsubi(Jrbx, 8);
+        } else if (inl && (wc == P_neg || wc == P_not)) {
+            Jsl(1);
+            jm(1, 0xF7, wc == P_neg ? 3 : 2, Jrbx, -8);
+        } else if (inl && (wc == P_1plus || wc == P_2plus || wc == P_1minus || wc == P_2minus)) {
+            Jsl(1);
+            jm(1, 0x81, (wc == P_1plus || wc == P_2plus) ? 0 : 5, Jrbx, -8);
+            j32((wc == P_1plus || wc == P_1minus) ? 1 : 2);
+        } else if (inl && wc == P_2times) {
+            Jsl(1);
+            jm(1, 0xD1, 4, Jrbx, -8);         // shl qword [rbx-8], 1
+        } else if (inl && wc == P_2div) {
+            Jsl(1);
+            jld(Jrax, Jrbx, -8);
+            jr(1, 0x89, Jrax, Jrcx);
+            jr(1, 0xC1, 5, Jrcx);             // shr rcx, 63
+            jb(63);
+            jr(1, 0x01, Jrcx, Jrax);
+            jr(1, 0xD1, 7, Jrax);             // sar rax, 1
+            jst(Jrax, Jrbx, -8);
+        } else if (inl && (wc == P_equal || wc == P_unequal || wc == P_gtr ||
+                            wc == P_lss || wc == P_geq || wc == P_leq)) {
+            Jsl(2);
+            jld(Jrax, Jrbx, -16);
+            jm(1, 0x3B, Jrax, Jrbx, -8);
+            jtruth(wc == P_equal ? Jce : wc == P_unequal ? Jcne : wc == P_gtr ? Jcg :
+                   wc == P_lss ? Jcl : wc == P_geq ? Jcge : Jcle);
+            jst(Jrax, Jrbx, -16);
+            jsubi(Jrbx, 8);
+        } else if (inl && (wc == P_0equal || wc == P_0notequal || wc == P_0gtr || wc == P_0lss)) {
+            Jsl(1);
+            jld(Jrax, Jrbx, -8);
+            jr(1, 0x85, Jrax, Jrax);
+            jtruth(wc == P_0equal ? Jce : wc == P_0notequal ? Jcne : wc == P_0gtr ? Jcg : Jcl);
+            jst(Jrax, Jrbx, -8);
+        } else if (inl && wc == P_dup) {
+            Jsl(1);
+            Jso(1);
+            jld(Jrax, Jrbx, -8);
+            jpush();
+        } else if (inl && wc == P_drop) {
+            Jsl(1);
+            jsubi(Jrbx, 8);
+        } else if (inl && wc == P_swap) {
+            Jsl(2);
+            jld(Jrax, Jrbx, -8);
+            jld(Jrcx, Jrbx, -16);
+            jst(Jrax, Jrbx, -16);
+            jst(Jrcx, Jrbx, -8);
+        } else if (inl && wc == P_over) {
+            Jsl(2);
+            Jso(1);
+            jld(Jrax, Jrbx, -16);
+            jpush();
+        } else if (inl && wc == P_rot) {
+            Jsl(3);
+            jld(Jrax, Jrbx, -24);
+            jld(Jrcx, Jrbx, -16);
+            jld(Jrdx, Jrbx, -8);
+            jst(Jrcx, Jrbx, -24);
+            jst(Jrdx, Jrbx, -16);
+            jst(Jrax, Jrbx, -8);
+        } else if (inl && wc == P_2dup) {
+            Jsl(2);
+            Jso(2);
+            jld(Jrax, Jrbx, -16);
+            jld(Jrcx, Jrbx, -8);
+            jst(Jrax, Jrbx, 0);
+            jst(Jrcx, Jrbx, 8);
+            jaddi(Jrbx, 16);
+        } else if (inl && wc == P_2drop) {
+            Jsl(2);
+            jsubi(Jrbx, 16);
+        } else if (inl && (wc == P_at || wc == P_cat)) {
+            Jsl(1);
+            jld(Jrax, Jrbx, -8);
+            Jhpc(Jrax);
+            if (wc == P_at) {
+                jld(Jrax, Jrax, 0);
+            } else {
+                jm(1, 0x0FB6, Jrax, Jrax, 0); // movzx rax, byte [rax]
+            }
+            jst(Jrax, Jrbx, -8);
+        } else if (inl && (wc == P_bang || wc == P_plusbang || wc == P_cbang)) {
+            Jsl(2);
+            jld(Jrax, Jrbx, -8);
+            Jhpc(Jrax);
+            jld(Jrcx, Jrbx, -16);
+            jm(wc != P_cbang, wc == P_plusbang ? 0x01 : wc == P_bang ? 0x89 : 0x88, Jrcx, Jrax, 0);
+            jsubi(Jrbx, 16);
+        } else if (inl && wc == P_tor) {
+            Jrso(1);
+            Jsl(1);
+            jld(Jrax, Jrbx, -8);
+            jsubi(Jrbx, 8);
+            jst(Jrax, Jr13, 0);
+            jaddi(Jr13, 8);
+        } else if (inl && (wc == P_rfrom || wc == P_rfetch || wc == P_i || wc == P_j)) {
+            Jrsl(wc == P_i ? 3 : wc == P_j ? 6 : 1);
+            Jso(1);
+            jld(Jrax, Jr13, wc == P_j ? -32 : -8);
+            if (wc == P_rfrom) {
+                jsubi(Jr13, 8);
+            }
+            jpush();
+#ifdef SUPERINST
+        } else if (inl && wc == P_dupat) {
+            Jsl(1);
+            Jso(1);
+            jld(Jrax, Jrbx, -8);
+            Jhpc(Jrax);
+            jld(Jrax, Jrax, 0);
+            jpush();
+        } else if (inl && wc == P_iplus) {
+            Jrsl(3);
+            Jsl(1);
+            jld(Jrax, Jr13, -8);
+            jm(1, 0x01, Jrax, Jrbx, -8);
+        } else if (inl && wc == P_atplus) {
+            Jsl(2);
+            jld(Jrax, Jrbx, -8);
+            Jhpc(Jrax);
+            jld(Jrax, Jrax, 0);
+            jm(1, 0x01, Jrax, Jrbx, -16);
+            jsubi(Jrbx, 8);
+#endif
+        } else if (isprim) {
+            jcall(w, wc, body + i + 1);
+        } else if (w == dw) {
+            jcall(NULL, (codeptr) code, body + i + 1);
+        } else if (wc == P_var || wc == P_con) {
+            Jso(1);
+            jmovi(Jrax, (stackitem) (((stackitem *) w) + Dictwordl));
+            if (wc == P_con) {
+                jld(Jrax, Jrax, 0);
+            }
+            jpush();
+        } else if (jitcode(w)) {
+            jcall(NULL, wc, body + i + 1);
+        } else if (wc == P_nest || wc == P_dodoes) {
+            jcall(w, jitexec, body + i + 1);
+        } else {
+            jcall(w, wc, body + i + 1);
+        }
+    }
+
+    // EXIT.  Undo what the prologue did and return.
+
+    label[n] = jitp;
+#ifdef STACKFLOOR
+    jm(1, 0x8D, Jrax, Jr13, -8);
+    jm(1, 0x3B, Jrax, Jr12, Joff(rstack));
+    p = jjcc(Jcae);
+    jcall((dictword *) atl__env->s_exit, P_exit, NULL);
+    jfix(jjmp(), Jbail);
+    jpatch(p, jitp);
+#endif
+#ifdef WALKBACK
+    {
+        unsigned char *off;
+
+        jflag(Joff(enableWalkback), sizeof(atl__env->enableWalkback));
+        off = jjcc(Jce);
+        jld(Jrax, Jr12, Joff(walkbackPointer));
+        jm(1, 0x3B, Jrax, Jr12, Joff(walkback));
+        p = jjcc(Jcbe);
+        jsubi(Jrax, sizeof(dictword *));
+        jst(Jrax, Jr12, Joff(walkbackPointer));
+        jpatch(p, jitp);
+        jpatch(off, jitp);
+    }
+#endif
+    jld(Jrax, Jr13, -8);
+    jsubi(Jr13, 8);
+    jst(Jrax, Jr12, Joff(ip));
+    jst(Jrbx, Jr12, Joff(stk));
+    jst(Jr13, Jr12, Joff(rs));
+    jret();
+
+    bail = jitp;
+    jret();
+
+#ifdef BREAK
+    brk = jitp;
+    jst(Jrbx, Jr12, Joff(stk));
+    jst(Jr13, Jr12, Joff(rs));
+    jmovi(Jrax, (stackitem) jitbreak);
+    jb(0xFF); jb(0xD0);               // call rax
+    jfix(jjmp(), Jbail);
+#endif
+
+    // Failed checks.  Run the instruction's C code, then carry on
+    // wherever it left ip.
+
+    for (i = 0; i < jitnslow; i++) {
+        long k = jitslows[i].to;
+        dictword *w = body[k];
+
+        if (i > 0 && jitslows[i - 1].to == k) {
+            jpatch(jitslows[i].at, p);
+            continue;
+        }
+        p = jitp;
+        jpatch(jitslows[i].at, p);
+        jiti = k;
+        c = inlinecells(w, body + k + 1);
+        jcall(w, w->wcode, body + k + 1);
+        if (isbranch(w) || w->wcode == P_leave) {
+            jmovi(Jrcx, (stackitem) (body + aux[k]));
+            jr(1, 0x39, Jrcx, Jrax);          // cmp rax, rcx
+            jfix(jjcc(Jce), aux[k]);
+        }
+        jfix(jjmp(), k + 1 + c);
+    }
+
+    if (jitp > atl__env->jitTop) {
+        goto done;                    // out of room, leave it threaded
+    }
+    for (i = 0; i < jitnfix; i++) {
+        long k = jitfixes[i].to;
+
+        jpatch(jitfixes[i].at, k == Jexit ? label[n] : k == Jbail ? bail : k == Jbreak ? brk : label[k]);
+    }
+    atl__env->jitPtr = min(code + (((jitp - code) + 15) & ~15), atl__env->jitTop);
+    dw->wcode = (codeptr) code;
+
+done:
+    free(aux);
+    free(loops);
+    free(start);
+    free(label);
+    free(jitfixes);
+    free(jitslows);
+}
+
+#undef Jsl
+#undef Jso
+#undef Jrsl
+#undef Jrso
+#undef Jhpc
+#endif /* NATIVECODE */
+
+/*  PWALKBACK  --  Print walkback trace.  */
+
+void pwalkback(void) {
+    if (atl__env->enableWalkback && ((atl__env->currentWord != NULL) || (atl__env->walkbackPointer > atl__env->walkback))) {
+        fprintf(stderr, "walkback:\n");
+        if (atl__env->currentWord != NULL) {
+            fprintf(stderr, "   %s\n", atl__env->currentWord->wname + 1);
+        }
+        while (atl__env->walkbackPointer > atl__env->walkback) {
+            dictword *wb = *(--atl__env->walkbackPointer);
+            fprintf(stderr, "   %s\n", wb->wname + 1);
+        }
+    }
+}
+
+/*  TROUBLE  --  Common handler for serious errors.  */
+
+void trouble(char *kind) {
+#ifdef MEMMESSAGE
+    fprintf(stderr, "\n%s.\n", kind);
+#endif
+#ifdef WALKBACK
+    pwalkback();
+#endif /* WALKBACK */
+    P_abort();			      /* Abort */
+    // reset all interpretation state */
+    atl__env->isIgnoringComment = state = atlFalsity;
+    atl__env->tokPendingForget = atl__env->tokPendingDefine = atl__env->tokPendingStringLiteral = atl__env->tokPendingTickMark = atl__env->tokPendingTickCompile = atlFalse;
+}
+
+/*  ATL_ERROR  --  Handle error detected by user-defined primitive.  */
+
+void atl_error(char *kind) {
+    trouble(kind);
+    atl__env->evalStatus = ATL_APPLICATION;       /* Signify application-detected error */
+}
+
+/*  STAKOVER  --  Recover from stack overflow.	*/
+
+void stakover(void) {
+    trouble("Stack overflow");
+    atl__env->evalStatus = ATL_STACKOVER;
+}
+
+/*  STAKUNDER  --  Recover from stack underflow.  */
+
+void stakunder(void) {
+    trouble("Stack underflow");
+    atl__env->evalStatus = ATL_STACKUNDER;
+}
+
+/*  RSTAKOVER  --  Recover from return stack overflow.	*/
+
+void rstakover(void) {
+    trouble("Return stack overflow");
+    atl__env->evalStatus = ATL_RSTACKOVER;
+}
+
+/*  RSTAKUNDER	--  Recover from return stack underflow.  */
+
+void rstakunder(void) {
+    trouble("Return stack underflow");
+    atl__env->evalStatus = ATL_RSTACKUNDER;
+}
+
+#ifdef FPSTACK
+/*  FSTAKOVER  --  Recover from floating point stack overflow.  */
+
+void fstakover(void) {
+    trouble("Floating point stack overflow");
+    atl__env->evalStatus = ATL_FSTACKOVER;
+}
+
+/*  FSTAKUNDER  --  Recover from floating point stack underflow.  */
+
+void fstakunder(void) {
+    trouble("Floating point stack underflow");
+    atl__env->evalStatus = ATL_FSTACKUNDER;
+}
+#endif /* FPSTACK */
+
+#ifdef STACKGUARD
+/*  Guardset and GUARDCAUGHT  --  Catch faults in the stack guard pages.
+ Guardset(g) makes g the catch; the caller then sigsetjmp()s g.jump,
+ which returns the error when a fault unwinds to it, and puts back
+ g.outer before returning normally.  Its Memerrs is Guarderrs(g), so
+ a check that fails puts back g.outer on the way out too.
+ guardcaught() reports the error as the check STACKGUARD leaves out
+ would have.  */
+
+#define Guardset(g) (g).outer = atl__env->guardCatch; (g).nesting = atl__env->execNesting; \
+                    atl__env->guardCatch = &(g)
+#define Guarderrs(g) (atl__env->guardCatch = (g).outer, atl__env->evalStatus)
+
+static void guardcaught(struct guardcatch *g, int es) {
+    atl__env->guardCatch = g->outer;
+    atl__env->execNesting = g->nesting;
+    if (g->nesting == 0) {
+        atl__env->fuel = 0;
+    }
+#ifdef WALKBACK
+    if (atl__env->walkbackPointer > atl__env->walkback + atl__env->rsLength) {
+        atl__env->walkbackPointer = atl__env->walkback + atl__env->rsLength; /* Past the push that faulted */
+    }
+#endif
+    switch (es) {
+        case ATL_STACKOVER:
+            stakover();
+            break;
+        case ATL_STACKUNDER:
+            stakunder();
+            break;
+        case ATL_RSTACKOVER:
+            rstakover();
+            break;
+        default:
+            rstakunder();
+            break;
+    }
+}
+#endif /* STACKGUARD */
+
+// HEAPOVER
+// Recover from heap overflow.  Note that a heap
+// overflow does NOT wipe the heap; it's up to
+// the user to do this manually with FORGET or
+// some such.
+//
+void heapover(void) {
+    trouble("Heap overflow");
+    atl__env->evalStatus = ATL_HEAPOVER;
+}
+
+/*  BADPOINTER	--  Abort if bad pointer reference detected.  */
+
+void badpointer(void) {
+    trouble("Bad pointer");
+    atl__env->evalStatus = ATL_BADPOINTER;
+}
+
+/*  NOTCOMP  --  Compiler word used outside definition.  */
+
+void notcomp(void) {
+    trouble("Compiler word outside definition");
+    atl__env->evalStatus = ATL_NOTINDEF;
+}
+
+/*  DIVZERO  --  Attempt to divide by zero.  */
+
+void divzero(void) {
+    trouble("Divide by zero");
+    atl__env->evalStatus = ATL_DIVZERO;
+}
+
+/*  LONGSTRING  --  String literal too long for a temporary string buffer.  */
+
+void longstring(void) {
+    trouble("String too long");
+    atl__env->evalStatus = ATL_LONGSTRING;
+}
+
+/*  EXWORD  --	Execute a word (and any sub-words it may invoke). */
+
+#ifdef DIRECTTHREAD
+
+// The direct-threaded inner interpreter.  The built-in primitives that
+// show up in tight colon definitions are expanded in line as labels in
+// exword() and reached through a table of label addresses (a gcc/clang
+// extension), so executing one of them costs an indirect jump instead
+// of a call and return through wcode.  Every in-line primitive ends in
+// its own copy of the dispatch jump, which gives the branch predictor
+// one history per primitive rather than one for the whole loop.
+//
+// A cell is recognised as a built-in primitive by its position in the
+// block of dictionary items that atl_primdef() built from primt, so
+// the dictionary word layout is unchanged.  Everything else, including
+// primitives added later with atl_primdef(), is called through wcode.
+//
+// While the in-line primitives run, the virtual machine registers live
+// in locals: the instruction pointer, the stack and return stack
+// pointers and the top of stack item.  They are written back to the
+// state (Dsave) only when control leaves the fast path, that is around
+// a call through wcode and before an error is reported, and picked up
+// again (Dload) afterwards.  The cached top of stack is not kept in
+// memory, so the stack has one spare cell below its bottom for Dsave
+// to store it in when the stack is empty (see atl_init).
+//
+#ifndef __GNUC__
+#   error "DIRECTTHREAD requires labels as values (gcc or clang)"
+#endif
+
+#define Dprims      (ELEMENTS(primt) - 1)     // Number of built-in primitives
+
+// Dispatch the word in w.  Built-in primitives jump straight to their
+// label, anything else goes through Dother.  The label table is indexed
+// in stack items rather than dictionary items so that the index is a
+// shift; keeping the jump block that small lets the compiler give each
+// primitive its own copy of it.
+#define Ddispatch   { size_t pi = (size_t) (((char *) w) - ((char *) prims)); \
+                      if (pi < Dprims * sizeof(dictword)) goto *primlabel[pi / sizeof(stackitem)]; \
+                      goto Dother; }
+
+// Nothing is checked between words.  Breaks and the atl_exec() budget
+// are polled (Dpoll) only at the safe points, where a branch goes
+// backward, a loop goes round again or a colon definition is entered,
+// after ip has moved on (see Bpoll).  Tracing and FUSEPROFILE counting
+// are done by a separate instrumented loop, Dslow, entered when the
+// instrumented flag is set (see instrument()).
+#ifdef BREAK
+#   define Dpoll    if (atl__env->asyncBreakReceived || (atl__env->fuel > 0 && --atl__env->fuel == 0)) goto Dsafe;
+#else
+#   define Dpoll    if (atl__env->fuel > 0 && --atl__env->fuel == 0) goto Dsafe;
+#endif
+
+// Fetch and dispatch the next instruction
+#define Dnext       w = *ip++; Ddispatch
+
+// Register cache write-back and reload.  The stack limits are reloaded
+// too, as is the high-water mark kept under MEMSTAT.
+#ifdef MEMSTAT
+#   define Dsavemax if (smax > atl__env->stkMaxExtent) atl__env->stkMaxExtent = smax; \
+                    if (rmax > atl__env->rsMaxExtent) atl__env->rsMaxExtent = rmax;
+#   define Dloadmax smax = atl__env->stkMaxExtent; rmax = atl__env->rsMaxExtent;
+#   define Dmss(n)  if ((sp + (n)) > smax) smax = sp + (n);
+#   define Dmsr(n)  if ((rp + (n)) > rmax) rmax = rp + (n);
+#else
+#   define Dsavemax
+#   define Dloadmax
+#   define Dmss(n)
+#   define Dmsr(n)
+#endif
+#define Dsave       { sp[-1] = tos; atl__env->stk = sp; atl__env->rs = rp; atl__env->ip = ip; Dsavemax }
+#ifdef STACKCHECK
+#   define Dloadlim { sbot = atl__env->stack; stop = atl__env->stkTop; \
+                      rbot = atl__env->rstack; rtop = atl__env->rsTop; }
+#elif defined(STACKFLOOR)
+#   define Dloadlim { sbot = atl__env->stack; rbot = atl__env->rstack; }
+#else
+#   define Dloadlim
+#endif
+#define Dload       { ip = atl__env->ip; sp = atl__env->stk; tos = sp[-1]; rp = atl__env->rs; \
+                      Dloadlim Dloadmax }
+
+// Stack access on the cached registers.  Dpush spills the old top of
+// stack to memory; Dpop refills it.
+#define Dpush(x)    { stackitem Dt = (x); sp[-1] = tos; sp++; tos = Dt; }
+#define Dpop        { sp--; tos = sp[-1]; }
+#define Dnpop(n)    { sp -= (n); tos = sp[-1]; }
+
+// In-line versions of the stack and heap checks.  On error they save
+// the registers, leave the offending word as the current word for the
+// walkback and bail out of the interpreter; trouble() has already
+// cleared the instruction pointer.
+#define Dfail(f)    { Dsave; atl__env->currentWord = w; f(); goto Dexit; }
+#ifdef STACKFLOOR
+#   define Dsl(n)   if ((sp - sbot) < (n)) Dfail(stakunder)
+#   define Drsl(n)  if ((rp - rbot) < (n)) Dfail(rstakunder)
+#else
+#   define Dsl(n)
+#   define Drsl(n)
+#endif
+#ifndef STACKCHECK
+#   define Dso(n)
+#   define Drso(n)
+#else
+#   define Dso(n)   Dmss(n) if ((sp + (n)) > stop) Dfail(stakover)
+#   define Drso(n)  Dmsr(n) if ((rp + (n)) > rtop) Dfail(rstakover)
+#endif
+#ifdef NOMEMCHECK
+#   define Dhpc(a)
+#else
+#   define Dhpc(a)  if ((((stackitem *) (a)) < atl__env->heapBottom) || (((stackitem *) (a)) >= atl__env->heapTop)) Dfail(badpointer)
+#endif
+
+// Shapes shared by most of the arithmetic primitives
+#define Dbinary(op) Dsl(2); tos = sp[-2] op tos; sp--; Dnext
+#define Dcompare(op) Dsl(2); tos = (sp[-2] op tos) ? atlTruth : atlFalsity; sp--; Dnext
+#define Dunary(e)   Dsl(1); tos = (e); Dnext
+
+// gcc's cross-jumping pass would otherwise fold all the copies of the
+// dispatch jump back into one.
+#if defined(__GNUC__) && !defined(__clang__)
+__attribute__((optimize("no-crossjumping")))
+#endif
+void exword(dictword *wp) {
+    static void *primlabel[Dprims * Dictwordl];
+    static Boolean primlabelReady = atlFalse;
+    dictword *prims = atl__env->dictPrimitives;
+    dictword *w = wp;
+    dictword **ip;                      // instruction pointer
+    stackitem *sp, tos;                 // stack pointer and top of stack
+    dictword ***rp;                     // return stack pointer
+#ifdef STACKFLOOR
+    stackitem *sbot;                    // stack bottom
+    dictword ***rbot;                   // return stack bottom
+#endif
+#ifdef STACKCHECK
+    stackitem *stop;                    // stack top
+    dictword ***rtop;                   // return stack top
+#endif
+#ifdef MEMSTAT
+    stackitem *smax;                    // stack maximum excursion
+    dictword ***rmax;                   // return stack maximum excursion
+#endif
+
+    if (!primlabelReady) {
+        // Labels for the primitives expanded in line below.  Every other
+        // entry in primt is called through its wcode.
+        static const struct {
+            codeptr pcode;
+            void   *plabel;
+        } inl[] = {
+            {P_plus, &&L_plus},         {P_minus, &&L_minus},       {P_times, &&L_times},
+            {P_div, &&L_div},           {P_mod, &&L_mod},           {P_min, &&L_min},
+            {P_max, &&L_max},           {P_neg, &&L_neg},           {P_abs, &&L_abs},
+            {P_equal, &&L_equal},       {P_unequal, &&L_unequal},   {P_gtr, &&L_gtr},
+            {P_lss, &&L_lss},           {P_geq, &&L_geq},           {P_leq, &&L_leq},
+            {P_and, &&L_and},           {P_or, &&L_or},             {P_xor, &&L_xor},
+            {P_not, &&L_not},           {P_1plus, &&L_1plus},       {P_2plus, &&L_2plus},
+            {P_1minus, &&L_1minus},     {P_2minus, &&L_2minus},     {P_2times, &&L_2times},
+            {P_2div, &&L_2div},         {P_0equal, &&L_0equal},     {P_0notequal, &&L_0notequal},
+            {P_0gtr, &&L_0gtr},         {P_0lss, &&L_0lss},         {P_dup, &&L_dup},
+            {P_drop, &&L_drop},         {P_swap, &&L_swap},         {P_over, &&L_over},
+            {P_rot, &&L_rot},           {P_minusrot, &&L_minusrot}, {P_qdup, &&L_qdup},
+            {P_2dup, &&L_2dup},         {P_2drop, &&L_2drop},       {P_tor, &&L_tor},
+            {P_rfrom, &&L_rfrom},       {P_rfetch, &&L_rfetch},     {P_at, &&L_at},
+            {P_bang, &&L_bang},         {P_plusbang, &&L_plusbang}, {P_cat, &&L_cat},
+            {P_cbang, &&L_cbang},       {P_dolit, &&L_dolit},       {P_exit, &&L_exit},
+            {P_branch, &&L_branch},     {P_qbranch, &&L_qbranch},   {P_xdo, &&L_xdo},
+            {P_xqdo, &&L_xqdo},         {P_xloop, &&L_xloop},       {P_xploop, &&L_xploop},
+            {P_leave, &&L_leave},       {P_i, &&L_i},               {P_j, &&L_j},
+#ifdef SUPERINST
+            {P_litplus, &&L_litplus},   {P_dupat, &&L_dupat},       {P_iplus, &&L_iplus},
+            {P_atplus, &&L_atplus},     {P_liteqqbranch, &&L_liteqqbranch},
+#endif
+#ifdef STACKEFFECT
+            // The checks here are on registers and cost next to nothing,
+            // so the unchecked variants share the checked code.
+            {P_stackcheck, &&L_stackcheck},
+            {U_plus, &&L_plus},         {U_minus, &&L_minus},       {U_times, &&L_times},
+            {U_neg, &&L_neg},           {U_equal, &&L_equal},       {U_unequal, &&L_unequal},
+            {U_gtr, &&L_gtr},           {U_lss, &&L_lss},           {U_geq, &&L_geq},
+            {U_leq, &&L_leq},           {U_and, &&L_and},           {U_or, &&L_or},
+            {U_xor, &&L_xor},           {U_not, &&L_not},           {U_1plus, &&L_1plus},
+            {U_1minus, &&L_1minus},     {U_0equal, &&L_0equal},     {U_0lss, &&L_0lss},
+            {U_dup, &&L_dup},           {U_drop, &&L_drop},         {U_swap, &&L_swap},
+            {U_over, &&L_over},         {U_rot, &&L_rot},           {U_minusrot, &&L_minusrot},
+            {U_at, &&L_at},             {U_bang, &&L_bang},         {U_plusbang, &&L_plusbang},
+            {U_cat, &&L_cat},           {U_cbang, &&L_cbang},       {U_dolit, &&L_dolit},
+            {U_i, &&L_i},
+#endif
+        };
+        size_t i, j;
+
+        for (i = 0; i < Dprims; i++) {
+            primlabel[i * Dictwordl] = &&Dcall;
+            for (j = 0; j < ELEMENTS(inl); j++) {
+                if (primt[i].pcode == inl[j].pcode) {
+                    primlabel[i * Dictwordl] = inl[j].plabel;
+                }
+            }
+        }
+        primlabelReady = atlTrue;
+    }
+
+    instrument();
+
+    // The first word is always run through its wcode; for a colon
+    // definition that is P_nest, which sets up the instruction pointer.
+    // With no word, atl_resume() has set ip to carry on from.
+    if (wp != NULL) {
+        atl__env->currentWord = wp;
+#ifdef TRACE
+        if (atl__env->enableTrace) {
+            fprintf(stderr, "\ntrace: %s ", atl__env->currentWord->wname + 1);
+        }
+#endif /* TRACE */
+        (*atl__env->currentWord->wcode)();
+    }
+    if (atl__env->ip == NULL && !unpark()) {
+        goto Dexit;
+    }
+    if (atl__env->instrumented) {
+        goto Dslow;
+    }
+    Dload;
+    Dnext;
+
+Dother:
+    // Not a built-in primitive.  Colon definitions, variables and
+    // constants are common enough to handle here; the rest is called.
+    if (w->wcode == P_nest) {
+        Drso(1);
+#ifdef WALKBACK
+        if (atl__env->enableWalkback) {
+            *atl__env->walkbackPointer++ = w;   // append word to walkback stack
+        }
+#endif
+        *rp++ = ip;
+        ip = ((dictword **) w) + Dictwordl;
+        Dpoll;
+        Dnext;
+    }
+    if (w->wcode == P_var) {
+        Dso(1);
+        Dpush((stackitem) (((stackitem *) w) + Dictwordl));
+        Dnext;
+    }
+    if (w->wcode == P_con) {
+        Dso(1);
+        Dpush(*(((stackitem *) w) + Dictwordl));
+        Dnext;
+    }
+
+Dcall:
+    // Call the word's implementation with the state brought up to date.
+    Dsave;
+    atl__env->currentWord = w;
+    (*w->wcode)();
+    if (atl__env->ip == NULL) {
+        if (!unpark()) {
+            goto Dexit;
+        }
+        goto Dslow;                     // TRACE or FUSEPROFILE turned on
+    }
+    Dload;
+    Dnext;
+
+Dslow:
+    // The instrumented loop.  It runs every word through its wcode,
+    // with the state in atl__env, until the flag is cleared.
+    while (atl__env->instrumented) {
+#ifdef BREAK
+        if (atl__env->asyncBreakReceived) {
+            trouble("Break signal");
+            atl__env->evalStatus = ATL_BREAK;
+            goto Dexit;
+        }
+#endif /* BREAK */
+        w = atl__env->currentWord = *atl__env->ip++;
+#ifdef TRACE
+        if (atl__env->enableTrace) {
+            fprintf(stderr, "\ntrace: %s ", atl__env->currentWord->wname + 1);
+        }
+#endif /* TRACE */
+#ifdef SUPERINST
+        if (atl__env->fuseProfiling) {
+            fuserecord(w);
+        }
+#endif /* SUPERINST */
+        (*w->wcode)();
+        if (atl__env->ip == NULL && !unpark()) {
+            goto Dexit;
+        }
+    }
+    Dload;
+    Dnext;
+
+Dsafe:
+    Dsave;
+    if (safepoint()) {
+        goto Dexit;
+    }
+    Dnext;
+
+    // Arithmetic and logical primitives
+
+L_plus:     Dbinary(+);
+L_minus:    Dbinary(-);
+L_times:    Dbinary(*);
+L_div:
+    Dsl(2);
+#ifndef NOMEMCHECK
+    if (tos == 0) {
+        Dfail(divzero);
+    }
+#endif /* NOMEMCHECK */
+    tos = sp[-2] / tos;
+    sp--;
+    Dnext;
+L_mod:
+    Dsl(2);
+#ifndef NOMEMCHECK
+    if (tos == 0) {
+        Dfail(divzero);
+    }
+#endif /* NOMEMCHECK */
+    tos = sp[-2] % tos;
+    sp--;
+    Dnext;
+L_min:      Dsl(2); tos = min(sp[-2], tos); sp--; Dnext;
+L_max:      Dsl(2); tos = max(sp[-2], tos); sp--; Dnext;
+L_neg:      Dunary(-tos);
+L_abs:      Dunary(abs(tos));
+L_equal:    Dcompare(==);
+L_unequal:  Dcompare(!=);
+L_gtr:      Dcompare(>);
+L_lss:      Dcompare(<);
+L_geq:      Dcompare(>=);
+L_leq:      Dcompare(<=);
+L_and:      Dbinary(&);
+L_or:       Dbinary(|);
+L_xor:      Dbinary(^);
+L_not:      Dunary(~tos);
+L_1plus:    Dunary(tos + 1);
+L_2plus:    Dunary(tos + 2);
+L_1minus:   Dunary(tos - 1);
+L_2minus:   Dunary(tos - 2);
+L_2times:   Dunary(tos * 2);
+L_2div:     Dunary(tos / 2);
+L_0equal:   Dunary((tos == 0) ? atlTruth : atlFalsity);
+L_0notequal:Dunary((tos != 0) ? atlTruth : atlFalsity);
+L_0gtr:     Dunary((tos >  0) ? atlTruth : atlFalsity);
+L_0lss:     Dunary((tos <  0) ? atlTruth : atlFalsity);
+
+    // Stack mechanics
+
+L_dup:      Dsl(1); Dso(1); Dpush(tos); Dnext;
+L_drop:     Dsl(1); Dpop; Dnext;
+L_swap:     Dsl(2); { stackitem t = sp[-2]; sp[-2] = tos; tos = t; } Dnext;
+L_over:     Dsl(2); Dso(1); Dpush(sp[-2]); Dnext;
+L_rot:      Dsl(3); { stackitem t = sp[-3]; sp[-3] = sp[-2]; sp[-2] = tos; tos = t; } Dnext;
+L_minusrot: Dsl(3); { stackitem t = sp[-3]; sp[-3] = tos; tos = sp[-2]; sp[-2] = t; } Dnext;
+L_qdup:
+    Dsl(1);
+    if (tos != 0) {
+        Dso(1);
+        Dpush(tos);
+    }
+    Dnext;
+L_2dup:     Dsl(2); Dso(2); sp[-1] = tos; sp[0] = sp[-2]; sp += 2; Dnext;
+L_2drop:    Dsl(2); Dnpop(2); Dnext;
+L_tor:      Drso(1); Dsl(1); *rp++ = (rstackitem) tos; Dpop; Dnext;
+L_rfrom:    Drsl(1); Dso(1); rp--; Dpush((stackitem) *rp); Dnext;
+L_rfetch:   Drsl(1); Dso(1); Dpush((stackitem) rp[-1]); Dnext;
+
+    // Heap access
+
+L_at:       Dsl(1); Dhpc(tos); tos = *((stackitem *) tos); Dnext;
+L_bang:     Dsl(2); Dhpc(tos); *((stackitem *) tos) = sp[-2]; Dnpop(2); Dnext;
+L_plusbang: Dsl(2); Dhpc(tos); *((stackitem *) tos) += sp[-2]; Dnpop(2); Dnext;
+L_cat:      Dsl(1); Dhpc(tos); tos = *((unsigned char *) tos); Dnext;
+L_cbang:    Dsl(2); Dhpc(tos); *((unsigned char *) tos) = sp[-2]; Dnpop(2); Dnext;
+
+    // Literals and control flow
+
+L_dolit:    Dso(1); Dpush((stackitem) *ip); ip++; Dnext;
+L_exit:
+    Drsl(1);
+#ifdef WALKBACK
+    if (atl__env->enableWalkback) {
+        atl__env->walkbackPointer = (atl__env->walkbackPointer > atl__env->walkback) ? atl__env->walkbackPointer - 1 : atl__env->walkback;
+    }
+#endif
+    ip = *--rp;
+    if (ip == NULL) {
+        Dsave;
+        goto Dexit;
+    }
+    Dnext;
+L_branch:
+    if ((stackitem) *ip < 0) {
+        ip += (stackitem) *ip;
+        Dpoll;
+        Dnext;
+    }
+    ip += (stackitem) *ip;
+    Dnext;
+L_qbranch:
+    Dsl(1);
+    if (tos == 0) {
+        stackitem offset = (stackitem) *ip;
+
+        ip += offset;
+        Dpop;
+        if (offset < 0) {
+            Dpoll;
+        }
+        Dnext;
+    }
+    ip++;
+    Dpop;
+    Dnext;
+L_xdo:
+    Dsl(2);
+    Drso(3);
+    rp[0] = ip + ((stackitem) *ip);     // Push exit address from loop
+    rp[1] = (rstackitem) sp[-2];        // Push loop limit
+    rp[2] = (rstackitem) tos;           // and initial iteration value
+    rp += 3;
+    ip++;
+    Dnpop(2);
+    Dnext;
+L_xqdo:
+    Dsl(2);
+    if (tos == sp[-2]) {
+        ip += (stackitem) *ip;
+    } else {
+        Drso(3);
+        rp[0] = ip + ((stackitem) *ip);
+        rp[1] = (rstackitem) sp[-2];
+        rp[2] = (rstackitem) tos;
+        rp += 3;
+        ip++;
+    }
+    Dnpop(2);
+    Dnext;
+L_xloop:
+    Drsl(3);
+    rp[-1] = (rstackitem) (((stackitem) rp[-1]) + 1);
+    if (((stackitem) rp[-1]) == ((stackitem) rp[-2])) {
+        rp -= 3;
+        ip++;
+    } else {
+        ip += (stackitem) *ip;
+        Dpoll;
+    }
+    Dnext;
+L_xploop:
+    Dsl(1);
+    Drsl(3);
+    {
+        stackitem niter = ((stackitem) rp[-1]) + tos;
+
+        Dpop;
+        if ((niter >= ((stackitem) rp[-2])) && (((stackitem) rp[-1]) < ((stackitem) rp[-2]))) {
+            rp -= 3;
+            ip++;
+        } else {
+            ip += (stackitem) *ip;
+            rp[-1] = (rstackitem) niter;
+            Dpoll;
+        }
+    }
+    Dnext;
+L_leave:    Drsl(3); ip = rp[-3]; rp -= 3; Dnext;
+L_i:        Drsl(3); Dso(1); Dpush((stackitem) rp[-1]); Dnext;
+L_j:        Drsl(6); Dso(1); Dpush((stackitem) rp[-4]); Dnext;
+
+#ifdef SUPERINST
+    // Superinstructions
+
+L_litplus:  Dsl(1); tos += (stackitem) *ip; ip++; Dnext;
+L_liteqqbranch:
+    Dsl(1);
+    if (tos != (stackitem) ip[0]) {
+        stackitem offset = (stackitem) ip[1];
+
+        ip += 1 + offset;
+        Dpop;
+        if (offset < 0) {
+            Dpoll;
+        }
+        Dnext;
+    }
+    ip += 2;
+    Dpop;
+    Dnext;
+L_dupat:    Dsl(1); Dso(1); Dhpc(tos); Dpush(*((stackitem *) tos)); Dnext;
+L_iplus:    Drsl(3); Dsl(1); tos += (stackitem) rp[-1]; Dnext;
+L_atplus:   Dsl(2); Dhpc(tos); tos = sp[-2] + *((stackitem *) tos); sp--; Dnext;
+#endif /* SUPERINST */
+
+#ifdef STACKEFFECT
+L_stackcheck: Dsl((stackitem) ip[0]); Dso((stackitem) ip[1]); ip += 3; Dnext;
+#endif
+
+Dexit:
+    atl__env->currentWord = NULL;
+}
+
+#undef Ddispatch
+#undef Dpoll
+#undef Dnext
+#undef Dsavemax
+#undef Dloadmax
+#undef Dloadlim
+#undef Dmss
+#undef Dmsr
+#undef Dsave
+#undef Dload
+#undef Dpush
+#undef Dpop
+#undef Dnpop
+#undef Dfail
+#undef Dsl
+#undef Dso
+#undef Drsl
+#undef Drso
+#undef Dhpc
+#undef Dbinary
+#undef Dcompare
+#undef Dunary
+
+#else /* !DIRECTTHREAD */
+
+void exword(dictword *wp) {
+    instrument();
+    if (wp != NULL) {		      /* NULL carries on from ip (atl_resume) */
+        atl__env->currentWord = wp;
+#ifdef TRACE
+        if (atl__env->enableTrace) {
+            fprintf(stderr, "\ntrace: %s ", atl__env->currentWord->wname + 1);
+        }
+#endif /* TRACE */
+        (*atl__env->currentWord->wcode)();	      /* Execute the first word */
+    }
+    while (atl__env->ip != NULL || unpark()) {
+        if (!atl__env->instrumented) {
+            /* The lean loop: nothing to do between words.  Breaks are
+               polled by the words that loop or nest. */
+            while (atl__env->ip != NULL) {
+                atl__env->currentWord = *atl__env->ip++;
+                (*atl__env->currentWord->wcode)();
+            }
+            continue;
+        }
+
+        /* The instrumented loop, one word at a time while the flag is set. */
+#ifdef BREAK
+        if (atl__env->asyncBreakReceived) {		      /* Did we receive a break signal */
+            trouble("Break signal");
+            atl__env->evalStatus = ATL_BREAK;
+            break;
+        }
+#endif /* BREAK */
+        atl__env->currentWord = *atl__env->ip++;
+#ifdef TRACE
+        if (atl__env->enableTrace) {
+            fprintf(stderr, "\ntrace: %s ", atl__env->currentWord->wname + 1);
+        }
+#endif /* TRACE */
+#ifdef SUPERINST
+        if (atl__env->fuseProfiling) {
+            fuserecord(atl__env->currentWord);
+        }
+#endif /* SUPERINST */
+        (*atl__env->currentWord->wcode)();	      /* Execute the next word */
+    }
+    atl__env->currentWord = NULL;
+}
+
+#endif /* DIRECTTHREAD */
+
+// ATL_INIT
+// Initialise the ATLAST system.  The dynamic storage areas
+// are allocated unless the caller has preallocated buffers
+// for them and stored the addresses into the respective
+// pointers.  In either case, the storage management
+// pointers are initialised to the correct addresses.  If
+// the caller preallocates the buffers, it's up to him to
+// ensure that the length allocated agrees with the lengths
+// given by the atl_... cells.
+//
+void atl_init(void) {
+    if (atl__env->dict == NULL) {
+        atl_primdef(primt);	      /* Define primitive words */
+        atl__env->dictPrimitives = atl__env->dict;	      /* Remember where primt landed */
+        atl__env->dictFirstProtectedEntry = atl__env->dict;	      /* Set protected mark in dictionary */
+
+        /* Look up compiler-referenced words in the new dictionary and
+         save their compile addresses in static variables. */
+
+#define Cconst(cell, name)  cell = (stackitem) lookup(name, strlen(name)); if(cell==0)abort()
+        Cconst(atl__env->s_exit     , "EXIT");
+        Cconst(atl__env->s_lit      , "(LIT)");
+        Cconst(atl__env->s_flit     , "(FLIT)");
+        Cconst(atl__env->s_strlit   , "(STRLIT)");
+        Cconst(atl__env->s_dotparen , ".(");
+        Cconst(atl__env->s_qbranch  , "?BRANCH");
+        Cconst(atl__env->s_branch   , "BRANCH");
+        Cconst(atl__env->s_xdo      , "(XDO)");
+        Cconst(atl__env->s_xqdo     , "(X?DO)");
+        Cconst(atl__env->s_xloop    , "(XLOOP)");
+        Cconst(atl__env->s_pxloop   , "(+XLOOP)");
+        Cconst(atl__env->s_abortq   , "ABORT\"");
+#ifdef SUPERINST
+        Cconst(atl__env->s_2dup     , "2DUP");
+        Cconst(atl__env->s_atplus   , "(@+)");
+        Cconst(atl__env->s_dupat    , "(DUP@)");
+        Cconst(atl__env->s_iplus    , "(I+)");
+        Cconst(atl__env->s_liteqqbranch, "(LIT=?BRANCH)");
+        Cconst(atl__env->s_litplus  , "(LIT+)");
+#endif
+#undef Cconst
+        atl__env->preparedName = intern("(PREPARED)", 10, 0);
+#ifdef STACKEFFECT
+        atl__env->s_stackcheck = (stackitem) primword(P_stackcheck);
+#endif
+
+#ifdef STACKGUARD
+        // The stacks lie between guard pages (see guarded()), which a
+        // stack the caller supplied doesn't have, so ours are used.
+        // The direct-threaded interpreter's spare cell, as below, is
+        // inside the guards.
+#ifdef DIRECTTHREAD
+        atl__env->stack = (stackitem *) guarded(&atl__env->stkLength, 1);
+#else
+        atl__env->stack = (stackitem *) guarded(&atl__env->stkLength, 0);
+#endif
+        atl__env->rstack = (dictword ***) guarded(&atl__env->rsLength, 0);
+#ifdef WALKBACK
+        {
+            atl_int wl = atl__env->rsLength;
+
+            atl__env->walkback = (dictword **) guarded(&wl, 0);
+        }
+#endif
+        guardinstall();
+#elif defined(DIRECTTHREAD)
+        // The direct-threaded interpreter spills its cached top of stack
+        // into the cell below the stack when the stack is empty.  Carve
+        // that cell out of a caller-supplied stack.
+        if (atl__env->stack == NULL) {	      /* Allocate stack if needed */
+            atl__env->stack = ((stackitem *) Reserve(((unsigned int) atl__env->stkLength + 1) * sizeof(stackitem))) + 1;
+        } else {
+            atl__env->stack++;
+            atl__env->stkLength--;
+        }
+#else
+        if (atl__env->stack == NULL) {	      /* Allocate stack if needed */
+            atl__env->stack = (stackitem *) Reserve(((unsigned int) atl__env->stkLength) * sizeof(stackitem));
+        }
+#endif /* DIRECTTHREAD */
+        atl__env->stk = atl__env->stkBottom = atl__env->stack;
+#ifdef MEMSTAT
+        atl__env->stkMaxExtent = atl__env->stack;
+#endif
+        atl__env->stkTop = atl__env->stack + atl__env->stkLength;
+        if (atl__env->rstack == NULL) {	      /* Allocate return stack if needed */
+            atl__env->rstack = (dictword ***) Reserve(((unsigned int) atl__env->rsLength) * sizeof(dictword **));
+        }
+        atl__env->rs = atl__env->rsBottom = atl__env->rstack;
+#ifdef MEMSTAT
+        atl__env->rsMaxExtent = atl__env->rstack;
+#endif
+        atl__env->rsTop = atl__env->rstack + atl__env->rsLength;
+#ifdef FPSTACK
+        if (atl__env->fstack == NULL) {	      /* Allocate floating point stack if needed */
+            atl__env->fstack = (atl_real *) Reserve(((unsigned int) atl__env->fstkLength) * sizeof(atl_real));
+        }
+        atl__env->fstk = atl__env->fstack;
+#ifdef MEMSTAT
+        atl__env->fstkMaxExtent = atl__env->fstack;
+#endif
+        atl__env->fstkTop = atl__env->fstack + atl__env->fstkLength;
+#endif
+#ifdef WALKBACK
+        if (atl__env->walkback == NULL) {
+            atl__env->walkback = (dictword **) Reserve(((unsigned int) atl__env->rsLength) * sizeof(dictword *));
+        }
+        atl__env->walkbackPointer = atl__env->walkback;
+#endif
+        if (atl__env->heap == NULL) {
+
+            /* The temporary string buffers are placed at the start of the
+             heap, which permits us to pointer-check pointers into them
+             as within the heap extents.  Hence, the size of the buffer
+             we acquire for the heap is the sum of the heap and temporary
+             string requests. */
+
+            int i;
+            char *cp;
+
+            /* Force length of temporary strings to even number of stackitems.
+             atl_clone maps a heap of its own, laid out already. */
+            if (atl__env->heapBottom == NULL) {
+                atl__env->lengthTempStringBuffer += sizeof(stackitem) - (atl__env->lengthTempStringBuffer % sizeof(stackitem));
+                cp = Reserve((((unsigned int) atl__env->heapLength) * sizeof(stackitem)) + ((unsigned int) (atl__env->numberOfTempStringBuffers * atl__env->lengthTempStringBuffer)));
+                atl__env->heapBottom = (stackitem *) cp;
+            } else {
+                cp = (char *) atl__env->heapBottom;
+            }
+            atl__env->strbuf = (char **) alloc(((unsigned int) atl__env->numberOfTempStringBuffers) * sizeof(char *));
+            for (i = 0; i < atl__env->numberOfTempStringBuffers; i++) {
+                atl__env->strbuf[i] = cp;
+                cp += ((unsigned int) atl__env->lengthTempStringBuffer);
+            }
+            atl__env->idxCurrTempStringBuffer = 0;
+            atl__env->heap = (stackitem *) cp;  // allocatable heap starts after the temporary strings
+        }
+        /* The system state word is kept in the first word of the heap
+         so that pointer checking doesn't bounce references to it.
+         When creating the heap, we preallocate this word and initialise
+         the state to the interpretive state. */
+        atl__env->heapAllocPtr = atl__env->heap + 1;
+        state = atlFalsity;
+#ifdef MEMSTAT
+        atl__env->heapMaxExtent = atl__env->heapAllocPtr;
+#endif
+        atl__env->heapTop = atl__env->heap + atl__env->heapLength;
+
+        // now that dynamic memory is up and running, allocate constants and variables built into the system.
+
+#ifdef FILEIO
+        {   static struct {
+            char *sfn;
+            FILE *sfd;
+	    } stdfiles[] = {
+            {"STDIN", NULL},
+            {"STDOUT", NULL},
+            {"STDERR", NULL}
+	    };
+            int i;
+            dictword *dw;
+
+    	    /* On some systems stdin, stdout, and stderr aren't
+             constants which can appear in an initialisation.
+             So, we initialise them at runtime here. */
+
+    	    stdfiles[0].sfd = stdin;
+            stdfiles[1].sfd = stdout;
+            stdfiles[2].sfd = stderr;
+
+            for (i = 0; i < ELEMENTS(stdfiles); i++) {
+                if ((dw = atl_vardef(stdfiles[i].sfn, 2 * sizeof(stackitem))) != NULL) {
+                    stackitem *si = atl_body(dw);
+                    *si++ = FileSent;
+                    *si = (stackitem) stdfiles[i].sfd;
+                }
+            }
+        }
+#endif /* FILEIO */
+        atl__env->dictFirstProtectedEntry = atl__env->dict; // protect all standard words
+#ifdef IMAGE
+        imagemark();
+#endif
+    }
+}
+
+/*  ATL_LOOKUP	--  Look up a word in the dictionary.  Returns its
+ word item if found or NULL if the word isn't
+ in the dictionary. */
+
+dictword *atl_lookup(char *name) {
+    return lookup(name, strlen(name));
+}
+
+// ATL_BODY  --  Returns the address of the body of a word, given its dictionary entry.
+//
+stackitem *atl_body(dictword *dw) {
+    return ((stackitem *) dw) + Dictwordl;
+}
+
+/*  EXECRUN  --  Run dw, or carry on from ip if dw is NULL, for
+ atl_exec() and atl_resume().  Only the outermost call is budgeted.  */
+
+static void execrun(dictword *dw) {
+    if (atl__env->execNesting == 0) {
+        atl__env->fuel = atl__env->execBudget;
+    }
+    atl__env->execNesting++;
+    exword(dw);
+    atl__env->execNesting--;
+    if (atl__env->execNesting == 0) {
+        atl__env->fuel = 0;
+    }
+}
+
+/*  ATL_EXEC  --  Execute a word, given its dictionary address.  The
+ evaluation status for that word's execution is
+ returned.  The in-progress evaluation status is
+ preserved.  If execBudget is set, the word is
+ suspended once it has passed that many safe points
+ and ATL_SUSPENDED returned; see atl_resume(). */
+
+int atl_exec(dictword *dw) {
+    int sestat = atl__env->evalStatus;
+#ifdef STACKGUARD
+    struct guardcatch g;
+    int es;
+
+    Guardset(g);
+    if ((es = sigsetjmp(g.jump, 0)) != 0) {
+        guardcaught(&g, es);
+        atl__env->evalStatus = sestat;
+        return es;
+    }
+#endif
+
+    atl__env->evalStatus = ATL_SNORM;
+#ifdef BREAK
+    atl__env->asyncBreakReceived = atlFalse;		      /* Reset break received */
+#endif
+#undef Memerrs
+#ifdef STACKGUARD
+#define Memerrs Guarderrs(g)
+#else
+#define Memerrs atl__env->evalStatus
+#endif
+    Rso(1);
+    Rpush = atl__env->ip; 		      /* Push instruction pointer */
+    atl__env->ip = NULL;			      /* Keep exword from running away */
+    execrun(dw);
+    if (atl__env->evalStatus == ATL_SNORM) {      /* If word ran to completion */
+        Rsl(1);
+        atl__env->ip = R0;		      /* Pop the return stack */
+        Rpop;
+    }
+#undef Memerrs
+#define Memerrs
+#ifdef STACKGUARD
+    atl__env->guardCatch = g.outer;
+#endif
+    int restat = atl__env->evalStatus;
+    atl__env->evalStatus = sestat;
+    return restat;
+}
+
+/*  ATL_PREPARE  --  Compile a string, as atl_eval() would run it, into
+ a word of its own, once, so it can be run again and again with
+ atl_exec() without tokenising and looking it up each time.  The
+ word has no place in the dictionary; it is in the heap, behind a
+ cell pointing past its end, and goes with the heap on atl_unwind()
+ or FORGET.  It is saved with the heap by atl_save_image() and
+ atl_clone(), but the pointer returned is good only in this
+ interpreter; prepare the string again in a clone to run it there.
+ Returns NULL if the string doesn't compile.  */
+
+dictword *atl_prepare(char *sp) {
+    stackitem *hp = atl__env->heapAllocPtr;
+    stackitem *sk = atl__env->stk;
+    dictword *cw = atl__env->createWord;
+    dictword *dw;
+
+    if (state) {			      /* Not while compiling */
+        return NULL;
+    }
+    if (atl__env->heapAllocPtr + 1 + Dictwordl > atl__env->heapTop) {
+        return NULL;
+    }
+    atl__env->heapAllocPtr++;		      /* End of the word goes here */
+    dw = (dictword *) atl__env->heapAllocPtr;
+    dw->wnext = NULL;
+    dw->wname = atl__env->preparedName;
+    dw->wcode = P_var;
+    atl__env->heapAllocPtr += Dictwordl;
+    atl__env->createWord = dw;
+    state = atlTruth;
+    if (atl_eval(sp) == ATL_SNORM && state && atl__env->stk == sk) {
+        P_semicolon();			      /* Finish it as ; would */
+        if (atl__env->evalStatus == ATL_SNORM) {
+            *hp = (stackitem) atl__env->heapAllocPtr;
+            atl__env->createWord = cw;	      /* ; cleared the last CREATEd word */
+            return dw;
+        }
+    }
+    state = atlFalsity;			      /* Didn't compile; give it all back */
+    atl__env->createWord = cw;
+    atl__env->stk = sk;
+    atl__env->heapAllocPtr = hp;
+    return NULL;
+}
+
+/*  ATL_RELEASE  --  Give back a word made by atl_prepare().  Its
+ space is reclaimed if nothing has been put in the heap since;
+ otherwise it stays until the heap is cut back past it.  Either
+ way, dw must not be run again.  */
+
+void atl_release(dictword *dw) {
+    stackitem *hp = ((stackitem *) dw) - 1;
+
+    if ((stackitem *) *hp == atl__env->heapAllocPtr) {
+#ifdef NATIVECODE
+        jitforget(dw);
+#endif
+        atl__env->heapAllocPtr = hp;
+    }
+}
+
+/*  ATL_RESUME  --  Carry on with the word whose atl_exec() (or an
+ earlier atl_resume()) returned ATL_SUSPENDED, with a fresh budget.
+ The stack and return stack must be as that call left them.  Returns
+ status as atl_exec() does, or ATL_SNORM if nothing is suspended.  */
+
+int atl_resume(void) {
+    int sestat = atl__env->evalStatus;
+
+    if (atl__env->suspendedIp == NULL || atl__env->execNesting != 0) {
+        return ATL_SNORM;
+    }
+#ifdef STACKGUARD
+    struct guardcatch g;
+    int es;
+
+    Guardset(g);
+    if ((es = sigsetjmp(g.jump, 0)) != 0) {
+        guardcaught(&g, es);
+        atl__env->evalStatus = sestat;
+        return es;
+    }
+#endif
+    atl__env->evalStatus = ATL_SNORM;
+#ifdef BREAK
+    atl__env->asyncBreakReceived = atlFalse;		      /* Reset break received */
+#endif
+#undef Memerrs
+#ifdef STACKGUARD
+#define Memerrs Guarderrs(g)
+#else
+#define Memerrs atl__env->evalStatus
+#endif
+    atl__env->ip = atl__env->suspendedIp;
+    atl__env->suspendedIp = NULL;
+    execrun(NULL);
+    if (atl__env->evalStatus == ATL_SNORM) {      /* If word ran to completion */
+        Rsl(1);
+        atl__env->ip = R0;		      /* Pop what atl_exec() pushed */
+        Rpop;
+    }
+#undef Memerrs
+#define Memerrs
+#ifdef STACKGUARD
+    atl__env->guardCatch = g.outer;
+#endif
+    int restat = atl__env->evalStatus;
+    atl__env->evalStatus = sestat;
+    return restat;
+}
+
+/*  ATL_VARDEF  --  Define a variable word.  Called with the word's
+ name and the number of bytes of storage to allocate
+ for its body.  All words defined with atl_vardef()
+ have the standard variable action of pushing their
+ body address on the stack when invoked.  Returns
+ the dictionary item for the new word, or NULL if
+ the heap overflows. */
+
+dictword *atl_vardef(char *name, int size) {
+    dictword *di;
+    int isize = (size + (sizeof(stackitem) - 1)) / sizeof(stackitem);
+
+#undef Memerrs
+#define Memerrs NULL
+    atl__env->evalStatus = ATL_SNORM;
+    Ho(Dictwordl + isize);
+#undef Memerrs
+#define Memerrs
+    if (atl__env->evalStatus != ATL_SNORM)	      /* Did the heap overflow */
+        return NULL;		      /* Yes.  Return NULL */
+    atl__env->createWord = (dictword *) atl__env->heapAllocPtr;   /* Develop address of word */
+    atl__env->createWord->wcode = P_var;	      /* Store default code */
+    atl__env->heapAllocPtr += Dictwordl;		      /* Allocate heap space for word */
+    while (isize > 0) {
+        Hstore = 0;		      /* Allocate heap area and clear it */
+        isize--;
+    }
+    enter(name, strlen(name));	      /* Make dictionary entry for it */
+    di = atl__env->createWord;		      /* Save word address */
+    atl__env->createWord = NULL;		      /* Mark no word underway */
+    return di;			      /* Return new word */
+}
+
+// ATL_MARK --
+//  populate a "mark," which is a snapshot of important parts
+//  of the current state of the system
+//
+void atl__Mark(atl_statemark *mp) {
+    mp->mstack  = atl__env->stk;            // save stack position
+#ifdef FPSTACK
+    mp->mfstack = atl__env->fstk;           // save floating point stack position
+#endif
+    mp->mheap   = atl__env->heapAllocPtr;   // save heap allocation marker
+    mp->mrstack = atl__env->rs;             // set return stack pointer
+    mp->mdict   = atl__env->dict;           // save last item in dictionary
+    mp->mnames  = atl__env->nameAllocPtr;   // save name arena position
+#ifdef NATIVECODE
+    mp->mjit    = atl__env->jitPtr;         // save machine code position
+#endif
+}
+
+/*  ATL_UNWIND	--  Restore system state to previously saved state.  */
+
+void atl_unwind(atl_statemark *mp) {
+
+    /* If atl_mark() was called before the system was initialised, and
+     we've initialised since, we cannot unwind.  Just ignore the
+     unwind request.	The user must manually atl_init before an
+     atl_mark() request is made. */
+
+    if (mp->mdict == NULL)	      /* Was mark made before atl_init ? */
+        return; 		      /* Yes.  Cannot unwind past init */
+
+    atl__env->stk = mp->mstack;		      /* Roll back stack allocation */
+#ifdef FPSTACK
+    atl__env->fstk = mp->mfstack;
+#endif
+    atl__env->heapAllocPtr = mp->mheap;		      /* Reset heap state */
+    atl__env->rs = mp->mrstack; 	      /* Reset the return stack */
+
+    /* To unwind the dictionary, we can't just reset the pointer,
+     we must walk back through the chain and unhash the items
+     allocated after the mark was made.  Their names then go all
+     at once, by cutting the name arena back to the mark. */
+
+    while (atl__env->dict != NULL && atl__env->dict != atl__env->dictFirstProtectedEntry && atl__env->dict != mp->mdict) {
+        dictunhash(atl__env->dict);	      /* Unhash item */
+#ifdef NATIVECODE
+        jitforget(atl__env->dict);
+#endif
+        atl__env->dict = atl__env->dict->wnext;	      /* Link to previous item */
+    }
+    if (atl__env->dict == mp->mdict) {
+        nameunwind(mp->mnames);		      /* Release their names */
+#ifdef NATIVECODE
+        atl__env->jitPtr = mp->mjit;	      /* and code, with atl_prepare's */
+#endif
+    }
+    wlforget();				      /* and any wordlists made since */
+}
+
+/*  ATL_LOAD  --  Load a file into the system.  The file is read in
+    large blocks with read(), which takes whatever a pipe or socket has
+    ready rather than waiting for a full block, and evaluated a line at
+    a time.  Lines end at CR, LF, CR LF or LF CR, as with atl_fgetsp(),
+    and may be of any length: the buffer grows to hold the longest.  If
+    the file can seek, it is left positioned after the last line
+    evaluated.  */
+
+#define Loadblock 65536
+
+int atl_load(FILE *fp) {
+    int es = ATL_SNORM;
+    atl_statemark mk;
+    atl_int scomm = atl__env->isIgnoringComment;    // stack comment pending state
+    dictword **sip = atl__env->ip;	      /* Stack instruction pointer */
+    char *sinstr = atl__env->inputBuffer;   // stack input stream
+    int lineno = 0;		      /* Current line number */
+    int fd = fileno(fp);
+    long base = ftell(fp);	      /* File offset of the start, or -1 */
+    long bufpos = 0;		      /* Offset of buf[0] from base */
+    size_t size = Loadblock;
+    size_t head = 0, tail = 0;	      /* Unevaluated text is buf[head, tail) */
+    Boolean eof = atlFalse;
+    char *buf = alloc(size + 1);
+
+    if (base >= 0) {
+        lseek(fd, base, SEEK_SET);    /* Discard stdio's read-ahead */
+    }
+    atl__env->lineNumberLastLoadFailed = 0; // reset line number of error
+    atl__Mark(&mk);
+    atl__env->ip = NULL;			      /* Fool atl_eval into interp state */
+    while (atlTrue) {
+        char *lp = buf + head, *ep = lp, *end = buf + tail;
+
+        while (ep < end && *ep != '\n' && *ep != '\r') {
+            ep++;
+        }
+        if (ep < end - 1 || (ep < end && eof)) {
+            char c = *ep;
+
+            *ep++ = EOS;
+            if (ep < end && *ep == (c == '\r' ? '\n' : '\r')) {
+                ep++;
+            }
+            head = ep - buf;
+        } else if (eof) {
+            if (lp == end) {
+                break;
+            }
+            *end = EOS;		      /* Last line, unterminated */
+            head = tail;
+        } else {
+            ssize_t n;
+
+            if (head > 0) {	      /* Slide the partial line down */
+                memmove(buf, lp, tail - head);
+                bufpos += head;
+                tail -= head;
+                head = 0;
+            }
+            if (tail == size) {	      /* It fills the buffer: grow it */
+                char *nbuf = alloc(2 * size + 1);
+
+                memcpy(nbuf, buf, tail);
+                free(buf);
+                buf = nbuf;
+                size *= 2;
+            }
+            do {
+                n = read(fd, buf + tail, size - tail);
+            } while (n < 0 && errno == EINTR);
+            if (n <= 0) {
+                eof = atlTrue;
+            } else {
+                tail += n;
+            }
+            continue;
+        }
+        lineno++;
+        if ((es = atl_eval(lp)) != ATL_SNORM) {
+            atl__env->lineNumberLastLoadFailed = lineno; // save line number of error
+            atl_unwind(&mk);
+            break;
+        }
+    }
+    if (base >= 0) {
+        fseek(fp, base + bufpos + (long) head, SEEK_SET);
+    }
+    free(buf);
+    /* If there were no other errors, check for a runaway comment.  If
+     we ended the file in comment-ignore mode, set the runaway comment
+     error status and unwind the file.  */
+    if ((es == ATL_SNORM) && (atl__env->isIgnoringComment == atlTruth)) {
+#ifdef MEMMESSAGE
+        fprintf(stderr, "\nrunaway `(' comment.\n");
+#endif
+        es = ATL_RUNCOMM;
+        atl_unwind(&mk);
+    }
+    atl__env->isIgnoringComment = scomm;    // unstack comment pending status
+    atl__env->ip = sip;			      /* Unstack instruction pointer */
+    atl__env->inputBuffer = sinstr; // unstack input stream
+    return es;
+}
+
+#ifdef HEAPIMAGE
+
+/*  Heap images.  What was compiled into the heap since a mark is saved
+    to a file in a form another run of the same program can load back,
+    at the same point, in place of compiling it again.  LOADCACHE saves
+    what loading a source file compiled this way; IMAGE saves all that
+    was compiled since the system was initialised (SAVE-IMAGE) and
+    restores it into a freshly initialised one (atl_load_image).
+
+    The cells are saved with a tag for each saying how to relocate it:
+    a pointer into the heap is kept as an offset from the heap, one to
+    a dictionary item outside the heap (primitives) as its position in
+    dict, and a code address as its position in a table of the wcode
+    values in use (see cachetables), all of which the fingerprint makes
+    the same from run to run.  A wordlist is kept as cachelist has it.
+    Names aren't saved in the cells; each word's name is interned again
+    and the word hashed into its wordlist, as enter() would.  A word
+    atl_prepare made has a tag for its name, (PREPARED), which every
+    system has; it comes along with the heap it's in.  Anything else is
+    taken as a literal, so an image can't carry the address of anything
+    but the heap and the dictionary: a FILE kept in a variable, say, or
+    (with NATIVECODE) machine code.
+
+    The fingerprint covers the dictionary, the heap layout, the number
+    base, the wordlists and the settings that change compiled code, not
+    the lengths of the heap and stacks: the program loading an image
+    sets those up as the one that saved it did.  */
+
+#define Cachelit    0                 // Cell is a literal
+#define Cacheheap   1                 // Offset in bytes from heap
+#define Cacheword   2                 // Position of a dictionary item in dict
+#define Cachecode   3                 // Position in the code table
+#define Cachename   4                 // Word name, interned on loading
+#define Cachelist   5                 // Wordlist (see cachelist), LONG_MIN for none
+#define Cacheprep   6                 // preparedName, the name of atl_prepare's words
+#define Cacheextra  (5 + Wordorder)   // Cells saved after the heap's: createWord, base,
+                                      // orderDepth, current, wordlists, order
+#define Cachelo     (atl__env->heapBottom != NULL ? atl__env->heapBottom : atl__env->heap)
+
+struct cachehead {
+    char      magic[8];               // "ATLC" and version
+    unsigned long long key;           // Hash of the source, 0 for an image
+    unsigned long long print;         // Fingerprint of the system
+    unsigned long long sum;           // Hash of the rest of the file
+    long      start;                  // First cell compiled, cells from heap
+    long      cells;                  // Cells compiled
+    long      words;                  // Words defined, oldest first
+    long      head;                   // dict afterward, cells from heap
+};
+
+struct cacheword {
+    long      at;                     // The word, cells from heap
+    long      list;                   // Its wordlist (see cachelist)
+    char      named;                  // Has a name
+    char      flags;                  // Its name's flags
+    unsigned char len;                // Length of the name that follows
+};
+
+struct cachemark {
+    unsigned long long key;           // Hash of the source
+    unsigned long long print;         // Fingerprint of the system at the mark
+    stackitem *heapAllocPtr;          // Where what's saved starts
+    dictword  *dict;                  // dict then
+    stackitem *stk;                   // What loading a file mustn't change (LOADCACHE)
+    dictword ***rs;
+#ifdef FPSTACK
+    atl_real  *fstk;
+#endif
+#ifdef NATIVECODE
+    unsigned char *jitPtr;
+#endif
+    stackitem *heap;                  // Copy of the heap below heapAllocPtr
+};
+
+struct cacheref {
+    stackitem value;                  // Pointer
+    long      at;                     // Its position in its table
+};
+
+/*  CACHEHASH  --  Hash n bytes at p into h, eight at a time.  */
+
+static unsigned long long cachehash(unsigned long long h, const void *p, size_t n) {
+    const unsigned char *c = (const unsigned char *) p;
+    unsigned long long w;
+
+    for (; n >= 8; c += 8, n -= 8) {
+        memcpy(&w, c, 8);
+        h = (h ^ w) * 0x9E3779B97F4A7C15ULL;
+        h ^= h >> 32;
+    }
+    for (; n > 0; n--) {
+        h = (h ^ *c++) * 0x100000001B3ULL;
+    }
+    return h;
+}
+
+/*  CACHELIST  --  Wordlist wl as a number: -1 for FORTH-WORDLIST, the
+    others being in the heap, their offset in bytes from it.  */
+
+static long cachelist(struct wordlist *wl) {
+    return wl == &atl__env->forth ? -1 : (long) ((char *) wl - (char *) atl__env->heap);
+}
+
+/*  CACHEPRINT  --  Fingerprint the system as it is now.  */
+
+static unsigned long long cacheprint(void) {
+    unsigned long long h = 0xCBF29CE484222325ULL;
+    long v[13];
+    dictword *dw;
+    int i;
+
+    v[0] = (long) sizeof(stackitem);
+    v[1] = (long) sizeof(dictword);
+    v[2] = (long) (atl__env->heap - Cachelo);
+    v[3] = (long) (atl__env->heapAllocPtr - atl__env->heap);
+    v[4] = atl__env->currentNumberBase;
+    v[5] = cachelist(atl__env->current);
+    v[6] = atl__env->orderDepth;
+    v[7] = atl__env->wordlists != NULL ? cachelist(atl__env->wordlists) : 0;
+    v[8] = atl__env->enableFusion;
+    v[9] = atl__env->enableStackEffect;
+    v[10] = atl__env->enableJit;
+    v[11] = atl__env->enableSubthread;
+#ifdef SUPERINST
+    v[12] = atl__env->fuseMask;
+#else
+    v[12] = 0;
+#endif
+    h = cachehash(h, v, sizeof v);
+    for (i = 0; i < atl__env->orderDepth; i++) {
+        v[0] = cachelist(atl__env->order[i]);
+        h = cachehash(h, v, sizeof(long));
+    }
+    for (dw = atl__env->dict; dw != NULL; dw = dw->wnext) {
+        stackitem *p = (stackitem *) dw;
+
+        v[0] = (p >= Cachelo && p < atl__env->heapTop) ? (long) (p - atl__env->heap) : LONG_MIN;
+        v[1] = dw->wname != NULL ? cachelist(Dname(dw->wname)->nlist) : 0;
+        h = cachehash(h, v, 2 * sizeof(long));
+        if (dw->wname != NULL) {
+            struct dname *dn = Dname(dw->wname);
+
+            v[0] = dn->nflags & ~WORDUSED;    /* Which is set by looking it up */
+            h = cachehash(cachehash(h, v, sizeof(long)), dn->nname, dn->nlen);
+        }
+    }
+    return h;
+}
+
+/*  CACHETABLES  --  Make the tables that pointers to dictionary items
+    outside the heap and code addresses are saved as positions in.  The
+    items are those in dict from the newest; the code addresses are the
+    runtimes the compiler puts in wcode, then every item's wcode.  */
+
+static void cachetables(dictword *dict, stackitem **words, long *nwords, stackitem **codes, long *ncodes) {
+    static const codeptr runtimes[] = {P_nest, P_var, P_con, P_2con, P_arraysub, P_dodoes};
+    long n = 0, nw = 0, nc = 0, i;
+    dictword *dw;
+
+    for (dw = dict; dw != NULL; dw = dw->wnext) {
+        n++;
+    }
+    *words = (stackitem *) alloc((unsigned int) ((n + 1) * sizeof(stackitem)));
+    *codes = (stackitem *) alloc((unsigned int) ((n + ELEMENTS(runtimes)) * sizeof(stackitem)));
+    for (i = 0; i < (long) ELEMENTS(runtimes); i++) {
+        (*codes)[nc++] = (stackitem) runtimes[i];
+    }
+    for (dw = dict; dw != NULL; dw = dw->wnext) {
+        stackitem *p = (stackitem *) dw;
+
+        if (p < Cachelo || p >= atl__env->heapTop) {
+            (*words)[nw++] = (stackitem) dw;
+        }
+        (*codes)[nc++] = (stackitem) dw->wcode;
+    }
+    *nwords = nw;
+    *ncodes = nc;
+}
+
+static int cacherefcmp(const void *a, const void *b) {
+    stackitem x = ((const struct cacheref *) a)->value, y = ((const struct cacheref *) b)->value;
+
+    return x < y ? -1 : x > y;
+}
+
+/*  CACHESORT  --  Sort a table of n pointers by value for lookup.  */
+
+static struct cacheref *cachesort(stackitem *t, long n) {
+    struct cacheref *r = (struct cacheref *) alloc((unsigned int) ((n + 1) * sizeof(struct cacheref)));
+    long i;
+
+    for (i = 0; i < n; i++) {
+        r[i].value = t[i];
+        r[i].at = i;
+    }
+    qsort(r, (size_t) n, sizeof(struct cacheref), cacherefcmp);
+    return r;
+}
+
+/*  CACHEFIND  --  Position of v in a sorted table of n, or -1.  */
+
+static long cachefind(struct cacheref *r, long n, stackitem v) {
+    long lo = 0, hi = n;
+
+    while (lo < hi) {
+        long mid = (lo + hi) / 2;
+
+        if (r[mid].value < v) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return (lo < n && r[lo].value == v) ? r[lo].at : -1;
+}
+
+/*  CACHEREFS  --  Run through the n cells of a compiled region,
+    tagging each with how it's saved, and converting it in place to
+    what's saved.  Name cells are tagged already.  Returns False if a
+    cell points into the name arena, which can't be saved.  */
+
+static Boolean cacherefs(stackitem *cells, unsigned char *tags, long n, dictword *dict) {
+    stackitem *words, *codes;
+    struct cacheref *wref, *cref;
+    long nw, nc, i, at;
+    Boolean ok = atlTrue;
+
+    cachetables(dict, &words, &nw, &codes, &nc);
+    wref = cachesort(words, nw);
+    cref = cachesort(codes, nc);
+    for (i = 0; i < n && ok; i++) {
+        stackitem v = cells[i];
+        struct namechunk *nk;
+
+        if (tags[i] != Cachelit) {
+            cells[i] = 0;
+        } else if (v == (stackitem) &atl__env->forth) {
+            tags[i] = Cachelist;
+            cells[i] = -1;
+        } else if (v >= (stackitem) Cachelo && v < (stackitem) atl__env->heapTop) {
+            tags[i] = Cacheheap;
+            cells[i] = v - (stackitem) atl__env->heap;
+        } else if (v == (stackitem) atl__env->preparedName) {
+            tags[i] = Cacheprep;
+            cells[i] = 0;
+        } else if ((at = cachefind(wref, nw, v)) >= 0) {
+            tags[i] = Cacheword;
+            cells[i] = at;
+        } else if ((at = cachefind(cref, nc, v)) >= 0) {
+            tags[i] = Cachecode;
+            cells[i] = at;
+        } else {
+            for (nk = atl__env->names; nk != NULL; nk = nk->prev) {
+                if (v >= (stackitem) (nk + 1) && v < (stackitem) nk->top) {
+                    ok = atlFalse;
+                }
+            }
+        }
+    }
+    free(words);
+    free(codes);
+    free(wref);
+    free(cref);
+    return ok;
+}
+
+/*  CACHEWRITE  --  Write what was compiled since cm was marked to fp,
+    which must be able to seek.  Returns False if it can't be saved:
+    the system is compiling, something older than the mark was
+    forgotten, a word was made machine code, or a cell points into the
+    name arena.  */
+
+static Boolean cachewrite(FILE *fp, struct cachemark *cm) {
+    stackitem *h0 = cm->heapAllocPtr, *h1 = atl__env->heapAllocPtr;
+    long ncells = (long) (h1 - h0), n = ncells + Cacheextra, nwords = 0, i;
+    stackitem *cells = NULL;
+    unsigned char *tags = NULL;
+    dictword *dw, **defs = NULL;
+    struct cachehead ch;
+    Boolean ok = atlFalse;
+
+    if (state != atlFalsity || ncells < 0) {
+        return atlFalse;
+    }
+    for (dw = atl__env->dict; dw != cm->dict; dw = dw->wnext) {
+        if (dw == NULL || (stackitem *) dw < h0 || (stackitem *) dw + Dictwordl > h1) {
+            return atlFalse;          /* Something older was forgotten */
+        }
+        nwords++;
+    }
+    defs = (dictword **) alloc((unsigned int) ((nwords + 1) * sizeof(dictword *)));
+    for (i = nwords, dw = atl__env->dict; dw != cm->dict; dw = dw->wnext) {
+        defs[--i] = dw;
+    }
+
+    cells = (stackitem *) alloc((unsigned int) (n * sizeof(stackitem)));
+    tags = (unsigned char *) alloc((unsigned int) n);
+    memcpy(cells, h0, (size_t) ncells * sizeof(stackitem));
+    cells[ncells] = (stackitem) atl__env->createWord;
+    memset(tags, Cachelit, (size_t) n);
+    for (i = 0; i < nwords; i++) {
+        tags[(stackitem *) &defs[i]->wname - h0] = Cachename;
+    }
+    if (!cacherefs(cells, tags, ncells + 1, cm->dict)) {
+        goto done;
+    }
+    for (i = 0; i < nwords; i++) {
+        if (tags[(stackitem *) &defs[i]->wcode - h0] != Cachecode) {
+            goto done;                /* Machine code */
+        }
+    }
+    for (i = 0; i < ncells; i++) {
+        if (tags[i] == Cacheprep && (i + 1 >= ncells || tags[i + 1] != Cachecode)) {
+            goto done;                /* A prepared word's wcode, after its name */
+        }
+    }
+    cells[ncells + 1] = atl__env->currentNumberBase;
+    cells[ncells + 2] = atl__env->orderDepth;
+    for (i = 0; i < 2 + Wordorder; i++) {
+        struct wordlist *wl = i == 0 ? atl__env->current : i == 1 ? atl__env->wordlists :
+                              i - 2 < atl__env->orderDepth ? atl__env->order[i - 2] : NULL;
+
+        cells[ncells + 3 + i] = wl != NULL ? cachelist(wl) : LONG_MIN;
+        tags[ncells + 3 + i] = Cachelist;
+    }
+
+    memset(&ch, 0, sizeof ch);
+    memcpy(ch.magic, "ATLC0002", 8);
+    ch.key = cm->key;
+    ch.print = cm->print;
+    ch.start = (long) (h0 - atl__env->heap);
+    ch.cells = ncells;
+    ch.words = nwords;
+    ch.head = (long) ((stackitem *) atl__env->dict - atl__env->heap);
+    ch.sum = cachehash(cachehash(0xCBF29CE484222325ULL, cells, (size_t) n * sizeof(stackitem)), tags, (size_t) n);
+    ok = fwrite(&ch, sizeof ch, 1, fp) == 1 &&
+         fwrite(cells, sizeof(stackitem), (size_t) n, fp) == (size_t) n &&
+         fwrite(tags, 1, (size_t) n, fp) == (size_t) n;
+    for (i = 0; i < nwords && ok; i++) {
+        struct cacheword cw;
+        struct dname *dn = defs[i]->wname != NULL ? Dname(defs[i]->wname) : NULL;
+
+        memset(&cw, 0, sizeof cw);
+        cw.at = (long) ((stackitem *) defs[i] - atl__env->heap);
+        if (dn != NULL) {
+            cw.list = cachelist(dn->nlist);
+            cw.named = 1;
+            cw.flags = dn->nflags;
+            cw.len = dn->nlen;
+        }
+        ok = fwrite(&cw, sizeof cw, 1, fp) == 1 && (dn == NULL || fwrite(dn->nname, 1, cw.len, fp) == cw.len);
+        ch.sum = cachehash(cachehash(ch.sum, &cw, sizeof cw), dn != NULL ? dn->nname : "", cw.len);
+    }
+    ok = ok && fseek(fp, 0L, SEEK_SET) == 0 && fwrite(&ch, sizeof ch, 1, fp) == 1;
+
+done:
+    free(tags);
+    free(cells);
+    free(defs);
+    return ok;
+}
+
+/*  CACHEFILE  --  Write what was compiled since cm was marked to the
+    file name, under a name of its own first and then renamed, so that
+    a reader never sees half a file.  */
+
+static Boolean cachefile(const char *name, struct cachemark *cm) {
+    char *tmp = alloc((unsigned int) strlen(name) + 24);
+    Boolean ok = atlFalse;
+    FILE *fp;
+
+    sprintf(tmp, "%s.%ld", name, (long) getpid());
+    if ((fp = fopen(tmp, "wb")) != NULL) {
+        ok = cachewrite(fp, cm);
+        if (fclose(fp) != 0 || !ok || rename(tmp, name) != 0) {
+            remove(tmp);
+            ok = atlFalse;
+        }
+    }
+    free(tmp);
+    return ok;
+}
+
+/*  CACHEREAD  --  Load what was compiled from the file open on fd, if
+    it was saved on a system like this one is, marked in cm.  The file
+    is mapped, not read, and its cells relocated as they're copied to
+    the heap above heapAllocPtr; until that's moved over them and the
+    words linked in, which is done only when everything has been
+    checked, nothing has changed.  */
+
+static Boolean cacheread(int fd, struct cachemark *cm) {
+    struct stat sb;
+    struct cachehead ch;
+    stackitem *cells, *words = NULL, *codes = NULL, *h0 = atl__env->heapAllocPtr, extra[Cacheextra];
+    unsigned char *tags;
+    struct cacheword *cw = NULL;
+    struct wordlist *wl;
+    char *map = MAP_FAILED, *p, *end, **np = NULL;
+    long nw, nc, n, i;
+    unsigned long long sum;
+    Boolean ok = atlFalse;
+
+    /* The header is a multiple of a cell long, so the cells that follow
+       it are aligned in the mapping. */
+
+    if (fstat(fd, &sb) != 0 || !S_ISREG(sb.st_mode) || sb.st_size < (off_t) sizeof ch ||
+        (map = mmap(NULL, (size_t) sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+        goto done;
+    }
+    end = map + sb.st_size;
+    memcpy(&ch, map, sizeof ch);
+    if (memcmp(ch.magic, "ATLC0002", 8) != 0 || ch.key != cm->key || ch.print != cm->print ||
+        ch.start != (long) (h0 - atl__env->heap) ||
+        ch.cells < 0 || ch.cells > (long) (atl__env->heapTop - h0) ||
+        ch.words < 0 || ch.words > ch.cells / (long) Dictwordl) {
+        goto done;
+    }
+    n = ch.cells + Cacheextra;
+    if ((size_t) (end - map) - sizeof ch < (size_t) n * (sizeof(stackitem) + 1)) {
+        goto done;
+    }
+    cells = (stackitem *) (map + sizeof ch);
+    tags = (unsigned char *) (cells + n);
+    p = (char *) (tags + n);
+    sum = cachehash(cachehash(0xCBF29CE484222325ULL, cells, (size_t) n * sizeof(stackitem)), tags, (size_t) n);
+    cw = (struct cacheword *) alloc((unsigned int) ((ch.words + 1) * sizeof(struct cacheword)));
+    np = (char **) alloc((unsigned int) ((ch.words + 1) * sizeof(char *)));
+    for (i = 0; i < ch.words; i++) {
+        size_t len;
+
+        if ((size_t) (end - p) < sizeof(struct cacheword)) {
+            goto done;
+        }
+        memcpy(&cw[i], p, sizeof(struct cacheword));
+        p += sizeof(struct cacheword);
+        len = cw[i].named ? cw[i].len : 0;
+        if ((size_t) (end - p) < len || cw[i].at < ch.start || cw[i].at > ch.start + ch.cells - (long) Dictwordl ||
+            (cw[i].named && cw[i].list != -1 &&
+             (cw[i].list < 0 || cw[i].list > (long) ((char *) atl__env->heapTop - (char *) atl__env->heap) - (long) sizeof(struct wordlist)))) {
+            goto done;
+        }
+        np[i] = p;
+        p += len;
+        sum = cachehash(cachehash(sum, &cw[i], sizeof(struct cacheword)), np[i], len);
+    }
+    if (sum != ch.sum) {
+        goto done;
+    }
+
+    /* Relocate against the system as it is. */
+
+    cachetables(atl__env->dict, &words, &nw, &codes, &nc);
+    for (i = 0; i < n; i++) {
+        stackitem v = cells[i], *to = i < ch.cells ? h0 + i : extra + (i - ch.cells);
+
+        switch (tags[i]) {
+            case Cachelit:
+            case Cachename:
+                *to = v;
+                break;
+            case Cacheprep:
+                *to = (stackitem) atl__env->preparedName;
+                break;
+            case Cacheheap:
+                *to = v + (stackitem) atl__env->heap;
+                if (*to < (stackitem) Cachelo || *to >= (stackitem) atl__env->heapTop) {
+                    goto done;
+                }
+                break;
+            case Cacheword:
+                if (v < 0 || v >= nw) {
+                    goto done;
+                }
+                *to = words[v];
+                break;
+            case Cachecode:
+                if (v < 0 || v >= nc) {
+                    goto done;
+                }
+                *to = codes[v];
+                break;
+            case Cachelist:
+                if (v == -1) {
+                    *to = (stackitem) &atl__env->forth;
+                } else if (v == LONG_MIN) {
+                    *to = 0;
+                } else if (v < 0 || v > (long) ((char *) atl__env->heapTop - (char *) atl__env->heap) - (long) sizeof(struct wordlist)) {
+                    goto done;
+                } else {
+                    *to = v + (stackitem) atl__env->heap;
+                }
+                break;
+            default:
+                goto done;
+        }
+    }
+
+    /* Each word must chain to the one before, the first to dict; the
+       wordlists made in the cells to those made before them; and the
+       search order must have a current wordlist and no gaps. */
+
+    for (i = 0; i < ch.words; i++) {
+        dictword *dw = (dictword *) (atl__env->heap + cw[i].at);
+
+        if ((stackitem) dw->wnext != (i == 0 ? (stackitem) atl__env->dict : (stackitem) (atl__env->heap + cw[i - 1].at))) {
+            goto done;
+        }
+    }
+    if (ch.head != (ch.words > 0 ? cw[ch.words - 1].at : (long) ((stackitem *) atl__env->dict - atl__env->heap))) {
+        goto done;
+    }
+    for (wl = (struct wordlist *) extra[4], i = 0; wl != atl__env->wordlists; wl = wl->lnext, i++) {
+        if (wl == NULL || (stackitem *) wl < h0 || (stackitem *) wl + Wordlistl > h0 + ch.cells || i > ch.cells) {
+            goto done;
+        }
+    }
+    if (extra[2] < 0 || extra[2] > Wordorder || extra[3] == 0) {
+        goto done;
+    }
+    for (i = 0; i < extra[2]; i++) {
+        if (extra[5 + i] == 0) {
+            goto done;
+        }
+    }
+
+    /* Link it all in.  Wordlists made in the cells are hashed afresh. */
+
+    for (wl = (struct wordlist *) extra[4]; wl != atl__env->wordlists; wl = wl->lnext) {
+        wl->lhash = NULL;
+        wl->lmask = 0;
+        wl->lcount = 0;
+    }
+    for (i = 0; i < ch.words; i++) {
+        dictword *dw = (dictword *) (atl__env->heap + cw[i].at);
+
+        dw->wname = NULL;
+        if (cw[i].named) {
+            dw->wname = intern(np[i], cw[i].len, cw[i].flags);
+            Dname(dw->wname)->nlist = cw[i].list == -1 ? &atl__env->forth :
+                                      (struct wordlist *) ((char *) atl__env->heap + cw[i].list);
+        }
+        atl__env->dict = dw;	      /* As enter() does */
+        dicthash(dw);
+    }
+    atl__env->heapAllocPtr += ch.cells;
+    Msh(0);
+    atl__env->createWord = (dictword *) extra[0];
+    atl__env->currentNumberBase = (long) extra[1];
+    atl__env->orderDepth = (int) extra[2];
+    atl__env->current = (struct wordlist *) extra[3];
+    atl__env->wordlists = (struct wordlist *) extra[4];
+    for (i = 0; i < Wordorder; i++) {
+        atl__env->order[i] = (struct wordlist *) extra[5 + i];
+    }
+    ok = atlTrue;
+
+done:
+    if (map != MAP_FAILED) {
+        munmap(map, (size_t) sb.st_size);
+    }
+    free(np);
+    free(cw);
+    free(words);
+    free(codes);
+    return ok;
+}
+
+/*  CACHELOAD  --  Load what was compiled from the file name, as
+    cacheread does.  */
+
+static Boolean cacheload(const char *name, struct cachemark *cm) {
+    int fd = open(name, O_RDONLY);
+    Boolean ok;
+
+    if (fd < 0) {
+        return atlFalse;
+    }
+    ok = cacheread(fd, cm);
+    close(fd);
+    return ok;
+}
 
-            /* The temporary string buffers are placed at the start of the
-             heap, which permits us to pointer-check pointers into them
-             as within the heap extents.  Hence, the size of the buffer
-             we acquire for the heap is the sum of the heap and temporary
-             string requests. */
+#ifdef LOADCACHE
 
-            int i;
-            char *cp;
+/*  Compiled-code cache.  When atl__env->cachePath is set, atl__LoadFile
+    saves what a file compiled in a cache file named for a hash of the
+    source and the fingerprint of the system it was compiled on.  The
+    next load of the same source on the same system loads the cells in
+    place of evaluating it.
 
-            /* Force length of temporary strings to even number of stackitems. */
-            atl__env->lengthTempStringBuffer += sizeof(stackitem) - (atl__env->lengthTempStringBuffer % sizeof(stackitem));
-            cp = alloc((((unsigned int) atl__env->heapLength) * sizeof(stackitem)) + ((unsigned int) (atl__env->numberOfTempStringBuffers * atl__env->lengthTempStringBuffer)));
-            atl__env->heapBottom = (stackitem *) cp;
-            atl__env->strbuf = (char **) alloc(((unsigned int) atl__env->numberOfTempStringBuffers) * sizeof(char *));
-            for (i = 0; i < atl__env->numberOfTempStringBuffers; i++) {
-                atl__env->strbuf[i] = cp;
-                cp += ((unsigned int) atl__env->lengthTempStringBuffer);
-            }
-            atl__env->idxCurrTempStringBuffer = 0;
-            atl__env->heap = (stackitem *) cp;  // allocatable heap starts after the temporary strings
-        }
-        /* The system state word is kept in the first word of the heap
-         so that pointer checking doesn't bounce references to it.
-         When creating the heap, we preallocate this word and initialise
-         the state to the interpretive state. */
-        atl__env->heapAllocPtr = atl__env->heap + 1;
-        state = atlFalsity;
-#ifdef MEMSTAT
-        atl__env->heapMaxExtent = atl__env->heapAllocPtr;
+    A file is cached only if its load did nothing else that can be
+    seen but define words, wordlists and the search order: the stacks
+    are as they were, the heap below it unchanged, and (with NATIVECODE)
+    no machine code made.  Output and other side effects of loading a
+    file are not replayed.  */
+
+/*  CACHEMARK  --  Note what loading a file mustn't change, so that
+    cachesave can tell if its result can be cached.  */
+
+static void cachemark(struct cachemark *cm) {
+    size_t n = (size_t) (atl__env->heapAllocPtr - atl__env->heap);
+
+    cm->heapAllocPtr = atl__env->heapAllocPtr;
+    cm->dict = atl__env->dict;
+    cm->stk = atl__env->stk;
+    cm->rs = atl__env->rs;
+#ifdef FPSTACK
+    cm->fstk = atl__env->fstk;
 #endif
-        atl__env->heapTop = atl__env->heap + atl__env->heapLength;
+#ifdef NATIVECODE
+    cm->jitPtr = atl__env->jitPtr;
+#endif
+    cm->heap = (stackitem *) alloc((unsigned int) (n * sizeof(stackitem)));
+    memcpy(cm->heap, atl__env->heap, n * sizeof(stackitem));
+}
 
-        // now that dynamic memory is up and running, allocate constants and variables built into the system.
+/*  CACHESAVE  --  If the file just loaded after marking cm can be
+    cached, write what it compiled to the cache file name.  */
 
-#ifdef FILEIO
-        {   static struct {
-            char *sfn;
-            FILE *sfd;
-	    } stdfiles[] = {
-            {"STDIN", NULL},
-            {"STDOUT", NULL},
-            {"STDERR", NULL}
-	    };
-            int i;
-            dictword *dw;
+static void cachesave(const char *name, struct cachemark *cm) {
+    if (atl__env->stk == cm->stk && atl__env->rs == cm->rs &&
+#ifdef FPSTACK
+        atl__env->fstk == cm->fstk &&
+#endif
+#ifdef NATIVECODE
+        atl__env->jitPtr == cm->jitPtr &&
+#endif
+        atl__env->heapAllocPtr >= cm->heapAllocPtr &&
+        memcmp(atl__env->heap, cm->heap, (size_t) (cm->heapAllocPtr - atl__env->heap) * sizeof(stackitem)) == 0) {
+        cachefile(name, cm);
+    }
+    free(cm->heap);
+}
 
-    	    /* On some systems stdin, stdout, and stderr aren't
-             constants which can appear in an initialisation.
-             So, we initialise them at runtime here. */
+/*  CACHEEVAL  --  Evaluate the n bytes of source at text, loaded from
+    a file, through the cache.  */
 
-    	    stdfiles[0].sfd = stdin;
-            stdfiles[1].sfd = stdout;
-            stdfiles[2].sfd = stderr;
+static int cacheeval(char *text, size_t n) {
+    struct cachemark cm;
+    char *name;
+    int es;
 
-            for (i = 0; i < ELEMENTS(stdfiles); i++) {
-                if ((dw = atl_vardef(stdfiles[i].sfn, 2 * sizeof(stackitem))) != NULL) {
-                    stackitem *si = atl_body(dw);
-                    *si++ = FileSent;
-                    *si = (stackitem) stdfiles[i].sfd;
-                }
-            }
+    if (atl__env->dict == NULL) {     /* Not initialised: nothing to fingerprint */
+        return atl__EvalText(text);
+    }
+    cm.key = cachehash(0xCBF29CE484222325ULL, text, n);
+    cm.print = cacheprint();
+    name = alloc((unsigned int) strlen(atl__env->cachePath) + 38);
+    sprintf(name, "%s%016llx%016llx.atc", atl__env->cachePath, cm.key, cm.print);
+    if (cacheload(name, &cm)) {
+        atl__env->lineNumberLastLoadFailed = 0;
+        es = ATL_SNORM;
+    } else {
+        cachemark(&cm);
+        if ((es = atl__EvalText(text)) == ATL_SNORM) {
+            cachesave(name, &cm);
+        } else {
+            free(cm.heap);
         }
-#endif /* FILEIO */
-        atl__env->dictFirstProtectedEntry = atl__env->dict; // protect all standard words
     }
+    free(name);
+    return es;
 }
 
-/*  ATL_LOOKUP	--  Look up a word in the dictionary.  Returns its
- word item if found or NULL if the word isn't
- in the dictionary. */
+#endif /* LOADCACHE */
 
-dictword *atl_lookup(char *name) {
-    strcpy(atl__env->tokbuf, name);	      /* Use built-in token buffer... */
-    ucase(atl__env->tokbuf);                    /* so ucase() doesn't wreck arg string */
-    return lookup(atl__env->tokbuf);	      /* Now use normal lookup() on it */
-}
+#ifdef IMAGE
 
-// ATL_BODY  --  Returns the address of the body of a word, given its dictionary entry.
-//
-stackitem *atl_body(dictword *dw) {
-    return ((stackitem *) dw) + Dictwordl;
+/*  IMAGEMARK  --  Mark where an image starts: the end of what atl_init
+    and the last atl_primdef made, which any program that loads the
+    image makes the same way.  */
+
+static void imagemark(void) {
+    atl__env->imageHeap = atl__env->heapAllocPtr;
+    atl__env->imageDict = atl__env->dict;
+    atl__env->imagePrint = cacheprint();
 }
 
-/*  ATL_EXEC  --  Execute a word, given its dictionary address.  The
- evaluation status for that word's execution is
- returned.  The in-progress evaluation status is
- preserved. */
+/*  ATL_SAVE_IMAGE  --  Save what has been compiled since the image
+    mark, the words, their wordlists and the search order, to the file
+    path.  Words atl_prepare made are saved with the rest of the heap.
+    Returns ATL_SNORM, or ATL_BADIMAGE if it can't be saved: while
+    compiling, when something older than the mark has been forgotten,
+    or when a word has been made machine code.  */
 
-int atl_exec(dictword *dw) {
-    int sestat = atl__env->evalStatus;
+int atl_save_image(const char *path) {
+    struct cachemark cm;
 
-    atl__env->evalStatus = ATL_SNORM;
-#ifdef BREAK
-    atl__env->asyncBreakReceived = atlFalse;		      /* Reset break received */
-#endif
-#undef Memerrs
-#define Memerrs atl__env->evalStatus
-    Rso(1);
-    Rpush = atl__env->ip; 		      /* Push instruction pointer */
-    atl__env->ip = NULL;			      /* Keep exword from running away */
-    exword(dw);
-    if (atl__env->evalStatus == ATL_SNORM) {      /* If word ran to completion */
-        Rsl(1);
-        atl__env->ip = R0;		      /* Pop the return stack */
-        Rpop;
+    if (atl__env->dict == NULL) {
+        return ATL_BADIMAGE;
     }
-#undef Memerrs
-#define Memerrs
-    int restat = atl__env->evalStatus;
-    atl__env->evalStatus = sestat;
-    return restat;
+    memset(&cm, 0, sizeof cm);
+    cm.print = atl__env->imagePrint;
+    cm.heapAllocPtr = atl__env->imageHeap;
+    cm.dict = atl__env->imageDict;
+    return cachefile(path, &cm) ? ATL_SNORM : ATL_BADIMAGE;
 }
 
-/*  ATL_VARDEF  --  Define a variable word.  Called with the word's
- name and the number of bytes of storage to allocate
- for its body.  All words defined with atl_vardef()
- have the standard variable action of pushing their
- body address on the stack when invoked.  Returns
- the dictionary item for the new word, or NULL if
- the heap overflows. */
+/*  ATL_LOAD_IMAGE  --  Load an image saved by atl_save_image into a
+    system just initialised, calling atl_init first if it hasn't been.
+    Returns ATL_SNORM, or ATL_BADIMAGE if the file can't be read or
+    wasn't saved by a system set up like this one, in which case
+    nothing is changed.  */
 
-dictword *atl_vardef(char *name, int size) {
-    dictword *di;
-    int isize = (size + (sizeof(stackitem) - 1)) / sizeof(stackitem);
+int atl_load_image(const char *path) {
+    struct cachemark cm;
 
-#undef Memerrs
-#define Memerrs NULL
-    atl__env->evalStatus = ATL_SNORM;
-    Ho(Dictwordl + isize);
-#undef Memerrs
-#define Memerrs
-    if (atl__env->evalStatus != ATL_SNORM)	      /* Did the heap overflow */
-        return NULL;		      /* Yes.  Return NULL */
-    atl__env->createWord = (dictword *) atl__env->heapAllocPtr;   /* Develop address of word */
-    atl__env->createWord->wcode = P_var;	      /* Store default code */
-    atl__env->heapAllocPtr += Dictwordl;		      /* Allocate heap space for word */
-    while (isize > 0) {
-        Hstore = 0;		      /* Allocate heap area and clear it */
-        isize--;
+    if (atl__env->dict == NULL) {
+        atl_init();
     }
-    strcpy(atl__env->tokbuf, name);	      /* Use built-in token buffer... */
-    ucase(atl__env->tokbuf);                    /* so ucase() doesn't wreck arg string */
-    enter(atl__env->tokbuf);		      /* Make dictionary entry for it */
-    di = atl__env->createWord;		      /* Save word address */
-    atl__env->createWord = NULL;		      /* Mark no word underway */
-    return di;			      /* Return new word */
-}
-
-// ATL_MARK --
-//  populate a "mark," which is a snapshot of important parts
-//  of the current state of the system
-//
-void atl__Mark(atl_statemark *mp) {
-    mp->mstack  = atl__env->stk;            // save stack position
-    mp->mheap   = atl__env->heapAllocPtr;   // save heap allocation marker
-    mp->mrstack = atl__env->rs;             // set return stack pointer
-    mp->mdict   = atl__env->dict;           // save last item in dictionary
+    memset(&cm, 0, sizeof cm);
+    cm.print = cacheprint();
+    return cacheload(path, &cm) ? ATL_SNORM : ATL_BADIMAGE;
 }
 
-/*  ATL_UNWIND	--  Restore system state to previously saved state.  */
+#endif /* IMAGE */
 
-void atl_unwind(atl_statemark *mp) {
+#ifdef CLONE
 
-    /* If atl_mark() was called before the system was initialised, and
-     we've initialised since, we cannot unwind.  Just ignore the
-     unwind request.	The user must manually atl_init before an
-     atl_mark() request is made. */
+/*  Clones.  atl_clone makes a new interpreter holding what a parent has
+    compiled since its image mark, loaded as atl_load_image would load
+    it, and keeps the new heap, as it is then, in a temporary file.  The
+    clone's heap is a private mapping of the file: the pages the clone
+    writes become its own copies, the rest are read from the file, and
+    atl_reset throws the copies away by mapping the file again.  Clones
+    of one parent can't share its pages, as each clone's heap is at an
+    address of its own and the heap holds addresses.  */
 
-    if (mp->mdict == NULL)	      /* Was mark made before atl_init ? */
-        return; 		      /* Yes.  Cannot unwind past init */
+struct atlclone {
+    int         fd;                   // Temporary file holding the heap
+    size_t      length;               // Length of the heap, from heapBottom
+    atl_statemark mark;               // The clone as made
+    atlenv      pristine;
+};
 
-    atl__env->stk = mp->mstack;		      /* Roll back stack allocation */
-    atl__env->heapAllocPtr = mp->mheap;		      /* Reset heap state */
-    atl__env->rs = mp->mrstack; 	      /* Reset the return stack */
+/*  CLONEFILE  --  Open an unlinked temporary file length bytes long.  */
 
-    /* To unwind the dictionary, we can't just reset the pointer,
-     we must walk back through the chain and release all the name
-     buffers attached to the items allocated after the mark was
-     made. */
+static int clonefile(size_t length) {
+    FILE *fp = tmpfile();
+    int fd = fp != NULL ? dup(fileno(fp)) : -1;
 
-    while (atl__env->dict != NULL && atl__env->dict != atl__env->dictFirstProtectedEntry && atl__env->dict != mp->mdict) {
-        free(atl__env->dict->wname);	      /* Release name string for item */
-        atl__env->dict = atl__env->dict->wnext;	      /* Link to previous item */
+    if (fp != NULL) {
+        fclose(fp);
+    }
+    if (fd >= 0 && ftruncate(fd, (off_t) length) != 0) {
+        close(fd);
+        fd = -1;
     }
+    return fd;
 }
 
-/*  ATL_LOAD  --  Load a file into the system.	*/
+/*  CLONEMAP  --  Map the heap file of clone c privately at p.  */
 
-int atl_load(FILE *fp) {
-    int es = ATL_SNORM;
-    char s[134];
-    atl_statemark mk;
-    atl_int scomm = atl__env->isIgnoringComment;    // stack comment pending state
-    dictword **sip = atl__env->ip;	      /* Stack instruction pointer */
-    char *sinstr = atl__env->inputBuffer;   // stack input stream
-    int lineno = 0;		      /* Current line number */
+static Boolean clonemap(void *p, struct atlclone *c) {
+    return mmap(p, c->length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, c->fd, 0) != MAP_FAILED;
+}
 
-    atl__env->lineNumberLastLoadFailed = 0; // reset line number of error
-    atl__Mark(&mk);
-    atl__env->ip = NULL;			      /* Fool atl_eval into interp state */
-    while (atl_fgetsp(s, 132, fp) != NULL) {
-        lineno++;
-        if ((es = atl_eval(s)) != ATL_SNORM) {
-            atl__env->lineNumberLastLoadFailed = lineno; // save line number of error
-            atl_unwind(&mk);
-            break;
+/*  CLONEFREE  --  Give back all that atl_init allocated for e, a clone
+    that couldn't be finished, but its heap, which is the caller's
+    mapping of the heap file.  */
+
+static void clonefree(atlenv *e) {
+    struct namechunk *nc;
+    struct wordlist *wl;
+    dictword *dw, *prev = NULL, *block = NULL;
+
+    /* Each table atl_primdef defined is one block, its words linked in
+       order, so a word out of the heap not just after the one before it
+       starts a block.  A block is freed once it's been walked past. */
+
+    for (dw = e->dict; dw != NULL; prev = dw, dw = dw->wnext) {
+        if (((stackitem *) dw < e->heapBottom || (stackitem *) dw >= e->heapTop) && dw - 1 != prev) {
+            free(block);
+            block = dw;
         }
     }
-    /* If there were no other errors, check for a runaway comment.  If
-     we ended the file in comment-ignore mode, set the runaway comment
-     error status and unwind the file.  */
-    if ((es == ATL_SNORM) && (atl__env->isIgnoringComment == atlTruth)) {
-#ifdef MEMMESSAGE
-        fprintf(stderr, "\nrunaway `(' comment.\n");
+    free(block);
+#ifdef NATIVECODE
+    if (e->jitArena != NULL) {
+        munmap(e->jitArena, (size_t) e->jitLength);
+    }
 #endif
-        es = ATL_RUNCOMM;
-        atl_unwind(&mk);
+    for (wl = e->wordlists; wl != NULL; wl = wl->lnext) {
+        free(wl->lhash);
     }
-    atl__env->isIgnoringComment = scomm;    // unstack comment pending status
-    atl__env->ip = sip;			      /* Unstack instruction pointer */
-    atl__env->inputBuffer = sinstr; // unstack input stream
-    return es;
+    free(e->forth.lhash);
+    while ((nc = e->names) != NULL) {
+        e->names = nc->prev;
+        free(nc);
+    }
+    free(e->primTables);
+    free(e->strbuf);
+#ifdef STACKGUARD
+#define Unguard(p, n, spare) munmap(((char *) (p)) - (spare) * sizeof(stackitem) - Guardpages * guardPage, \
+                                    ((size_t) (n) + (spare)) * sizeof(stackitem) + 2 * Guardpages * guardPage)
+#ifdef DIRECTTHREAD
+    Unguard(e->stack, e->stkLength, 1);
+#else
+    Unguard(e->stack, e->stkLength, 0);
+#endif
+    Unguard(e->rstack, e->rsLength, 0);
+#ifdef WALKBACK
+    Unguard(e->walkback, e->rsLength, 0);
+#endif
+#undef Unguard
+#else
+#ifdef DIRECTTHREAD
+    Unreserve(e->stack - 1, ((size_t) e->stkLength + 1) * sizeof(stackitem));
+#else
+    Unreserve(e->stack, (size_t) e->stkLength * sizeof(stackitem));
+#endif
+    Unreserve(e->rstack, (size_t) e->rsLength * sizeof(dictword **));
+#ifdef WALKBACK
+    Unreserve(e->walkback, (size_t) e->rsLength * sizeof(dictword *));
+#endif
+#endif /* STACKGUARD */
+#ifdef FPSTACK
+    Unreserve(e->fstack, (size_t) e->fstkLength * sizeof(atl_real));
+#endif
+    free(e);
+}
+
+/*  ATL_CLONE  --  Make an interpreter set up as parent is, with all that
+    parent has compiled since it was initialised.  Returns NULL if that
+    can't be saved as an image (see atl_save_image) or the heap is the
+    caller's.  The current interpreter is left as it was; set atl__env
+    to the clone to use it.  */
+
+atlenv *atl_clone(atlenv *parent) {
+    atlenv *save = atl__env, *e = NULL;
+    struct atlclone *c = NULL;
+    struct cachemark cm;
+    char *block = MAP_FAILED;
+    size_t length = 0;
+    FILE *fp = NULL;
+    int fd = -1, i;
+    Boolean ok = atlFalse;
+
+    atl__env = parent;
+    if (parent->dict == NULL || parent->heapBottom == NULL || (fp = tmpfile()) == NULL) {
+        goto done;
+    }
+    memset(&cm, 0, sizeof cm);
+    cm.print = parent->imagePrint;
+    cm.heapAllocPtr = parent->imageHeap;
+    cm.dict = parent->imageDict;
+    length = (size_t) ((char *) parent->heapTop - (char *) parent->heapBottom);
+    if (!cachewrite(fp, &cm) || fflush(fp) != 0 || (fd = clonefile(length)) < 0 ||
+        (block = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED ||
+        (e = newenv()) == NULL) {
+        goto done;
+    }
+
+    /* Build the clone in a shared mapping of the heap file, so that the
+       file holds the heap as it's made. */
+
+    e->allowRedefinition = parent->allowRedefinition;
+    e->cachePath = parent->cachePath;
+    e->enableFusion = parent->enableFusion;
+    e->enableJit = parent->enableJit;
+    e->enableStackEffect = parent->enableStackEffect;
+    e->enableSubthread = parent->enableSubthread;
+    e->enableTrace = parent->enableTrace;
+    e->enableWalkback = parent->enableWalkback;
+    e->execBudget = parent->execBudget;
+    e->fstkLength = parent->fstkLength;
+    e->heapLength = parent->heapLength;
+    e->jitLength = parent->jitLength;
+    e->lengthTempStringBuffer = parent->lengthTempStringBuffer;
+    e->numberOfTempStringBuffers = parent->numberOfTempStringBuffers;
+    e->rsLength = parent->rsLength;
+    e->stkLength = parent->stkLength;
+#ifdef SUPERINST
+    e->fuseMask = parent->fuseMask;
+#endif
+    e->heapBottom = (stackitem *) block;
+    atl__env = e;
+    atl_init();
+    for (i = 0; i < parent->primTableCount; i++) {
+        atl_primdef(parent->primTables[i]);
+    }
+    cm.print = cacheprint();
+    if (!cacheread(fileno(fp), &cm)) {
+        goto done;
+    }
+    e->dictFirstProtectedEntry = e->dict;     /* atl_reset can't bring back what's forgotten */
+    c = (struct atlclone *) alloc(sizeof(struct atlclone));
+    c->fd = fd;
+    c->length = length;
+    atl__Mark(&c->mark);
+    e->clone = c;
+    c->pristine = *e;
+    ok = clonemap(block, c);
+
+done:
+    if (fp != NULL) {
+        fclose(fp);
+    }
+    if (!ok) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        free(c);
+        if (e != NULL && e->dict != NULL) {
+            clonefree(e);	      /* Before the heap its wordlists are in goes */
+        } else {
+            free(e);
+        }
+        if (block != MAP_FAILED) {
+            munmap(block, length);
+        }
+        e = NULL;
+    }
+    atl__env = save;
+    return e;
+}
+
+/*  ATL_RESET  --  Return the current interpreter, a clone, to what it
+    was when made: the words, wordlists and names made since go, as
+    atl_unwind drops them, and the pages of the heap it has written
+    since are thrown away.  Does nothing if it isn't a clone.  */
+
+void atl_reset(void) {
+    struct atlclone *c = atl__env->clone;
+    struct primfcn **pts;
+    struct wordlist forth, *wl, *lists;
+    long n = 0, i;
+    int npts;
+
+    if (c == NULL) {
+        return;
+    }
+    atl_unwind(&c->mark);
+
+    /* The hash tables, kept outside the heap, stay as atl_unwind left
+       them, and so do the wordlists' pointers to them. */
+
+    for (wl = atl__env->wordlists; wl != NULL; wl = wl->lnext) {
+        n++;
+    }
+    lists = (struct wordlist *) alloc((unsigned int) ((n + 1) * sizeof(struct wordlist)));
+    for (i = 0, wl = atl__env->wordlists; wl != NULL; wl = wl->lnext) {
+        lists[i++] = *wl;
+    }
+    forth = atl__env->forth;
+    pts = atl__env->primTables;
+    npts = atl__env->primTableCount;
+    if (!clonemap(atl__env->heapBottom, c)) {
+        fprintf(stderr, "\n\nCan't map the heap again!\n");
+        abort();
+    }
+    for (i = 0, wl = atl__env->wordlists; wl != NULL; wl = wl->lnext) {
+        *wl = lists[i++];
+    }
+    free(lists);
+    *atl__env = c->pristine;
+    atl__env->forth = forth;
+    atl__env->primTables = pts;
+    atl__env->primTableCount = npts;
 }
 
+#endif /* CLONE */
+
+#endif /* HEAPIMAGE */
+
 // ATL_PROLOGUE  --  Recognise and process prologue statement.
 // Returns 1 if the statement was part of the prologue and 0 otherwise.
 //
@@ -3843,6 +8900,18 @@ int atl_prologue(char *sp) {
                 return 1;
             }
         }
+#ifdef FPSTACK
+        proName = "FSTACK ";
+        if (strncmp(vp, proName, strlen(proName)) == 0) {
+            if ((ap = strchr(vp, ' ')) != NULL) {
+                atl__env->fstkLength = strtol(ap + 1, &tail, 10);
+#ifdef PROLOGUEDEBUG
+                fprintf(stderr, "prologue set %sto %ld\n", proName, atl__env->fstkLength);
+#endif
+                return 1;
+            }
+        }
+#endif
         proName = "HEAP ";
         if (strncmp(vp, proName, strlen(proName)) == 0) {
             if ((ap = strchr(vp, ' ')) != NULL) {
@@ -3867,13 +8936,29 @@ int atl_prologue(char *sp) {
     return 0;
 }
 
+/*  STRCOMPILE  --  Compile the string token in line, copying it
+    straight out of the input, as the number of cells it takes and then
+    the string.  The caller has made room for it.  */
+
+static void strcompile(void) {
+    size_t n = strdecode((char *) (atl__env->heapAllocPtr + 1), atl__env->tokptr, atl__env->toklen, atl__env->toklen);
+    stackitem l = (stackitem) ((n + sizeof(stackitem)) / sizeof(stackitem));
+
+    Hstore = l;
+    atl__env->heapAllocPtr += l;
+}
+
 // ATL_EVAL  --  Evaluate a string containing ATLAST words.
 //
 int atl_eval(char *sp) {
     int i;
 
 #undef  Memerrs
+#ifdef STACKGUARD
+#define Memerrs Guarderrs(g)
+#else
 #define Memerrs atl__env->evalStatus
+#endif
     atl__env->inputBuffer = sp;
     atl__env->evalStatus = ATL_SNORM;	      // Set normal evaluation status
     atl__env->asyncBreakReceived = atlFalse;		      // Reset asynchronous break
@@ -3892,6 +8977,16 @@ int atl_eval(char *sp) {
     }
 #endif // PROLOGUE
 
+#ifdef STACKGUARD
+    struct guardcatch g;
+    int es;
+
+    Guardset(g);
+    if ((es = sigsetjmp(g.jump, 0)) != 0) {
+        guardcaught(&g, es);
+        return atl__env->evalStatus;
+    }
+#endif
     while ((atl__env->evalStatus == ATL_SNORM) && (i = atl__env->nextToken(&(atl__env->inputBuffer))) != TokNull) {
         dictword *di;
 
@@ -3899,8 +8994,7 @@ int atl_eval(char *sp) {
             case TokWord:
                 if (atl__env->tokPendingForget) {
                     atl__env->tokPendingForget = atlFalse;
-                    ucase(atl__env->tokbuf);
-                    if ((di = lookup(atl__env->tokbuf)) != NULL) {
+                    if ((di = lookup(atl__env->tokptr, atl__env->toklen)) != NULL) {
                         dictword *dw = atl__env->dict;
 
                         // Pass 1.  Rip through the dictionary to make sure
@@ -3915,7 +9009,7 @@ int atl_eval(char *sp) {
                                 atl__env->evalStatus = ATL_FORGETPROT;
                                 di = NULL;
                             }
-                            if (strcmp(dw->wname + 1, atl__env->tokbuf) == 0) {
+                            if (dw == di) {
                                 break;
                             }
                             dw = dw->wnext;
@@ -3923,18 +9017,28 @@ int atl_eval(char *sp) {
 
                         // Pass 2.  Walk back through the dictionary
                         // items until we encounter the target
-                        // of the FORGET.  Release each item's
-                        // name buffer and dechain it from the
-                        // dictionary list. */
+                        // of the FORGET.  Unhash each item and
+                        // dechain it from the dictionary list, then
+                        // cut the name arena back to the oldest
+                        // of their names in it. */
 
                         if (di != NULL) {
+                            char *np = NULL;
+
                             do {
                                 dw = atl__env->dict;
-                                if (dw->wname != NULL) {
-                                    free(dw->wname);
+                                if (dw->wname != NULL && !Dname(dw->wname)->nheap) {
+                                    np = (char *) Dname(dw->wname);
                                 }
+                                dictunhash(dw);   /* Unhash item */
+#ifdef NATIVECODE
+                                jitforget(dw);
+#endif
                                 atl__env->dict = dw->wnext;
                             } while (dw != di);
+                            if (np != NULL) {
+                                nameunwind(np);
+                            }
                             // Finally, back the heap allocation pointer
                             // up to the start of the last item forgotten.
                             atl__env->heapAllocPtr = (stackitem *) di;
@@ -3950,22 +9054,22 @@ int atl_eval(char *sp) {
 #endif
                                 atl__env->heapAllocPtr--;
                             }
+                            wlforget();
                         }
                     } else {
 #ifdef MEMMESSAGE
-                        fprintf(stderr, " '%s' undefined ", atl__env->tokbuf);
+                        fprintf(stderr, " '%.*s' undefined ", (int) atl__env->toklen, atl__env->tokptr);
 #endif
                         atl__env->evalStatus = ATL_UNDEFINED;
                     }
                 } else if (atl__env->tokPendingTickMark) {
                     atl__env->tokPendingTickMark = atlFalse;
-                    ucase(atl__env->tokbuf);
-                    if ((di = lookup(atl__env->tokbuf)) != NULL) {
+                    if ((di = lookup(atl__env->tokptr, atl__env->toklen)) != NULL) {
                         So(1);
                         Push = (stackitem) di; // push word compile address
                     } else {
 #ifdef MEMMESSAGE
-                        fprintf(stderr, " '%s' undefined ", atl__env->tokbuf);
+                        fprintf(stderr, " '%.*s' undefined ", (int) atl__env->toklen, atl__env->tokptr);
 #endif
                         atl__env->evalStatus = ATL_UNDEFINED;
                     }
@@ -3974,13 +9078,16 @@ int atl_eval(char *sp) {
                     // leave the address of the new word item created for
                     // it on the return stack.
                     atl__env->tokPendingDefine = atlFalse;
-                    ucase(atl__env->tokbuf);
-                    if (atl__env->allowRedefinition && (lookup(atl__env->tokbuf) != NULL)) {
-                        fprintf(stderr, "\n%s isn't unique.", atl__env->tokbuf);
+                    if (atl__env->allowRedefinition) {
+                        size_t len = min(atl__env->toklen, Namemax);   // only the wordlist it goes in matters
+
+                        if (wlsearch(atl__env->current, atl__env->tokptr, namehash(atl__env->tokptr, len), len) != NULL) {
+                            fprintf(stderr, "\n%.*s isn't unique.", (int) atl__env->toklen, atl__env->tokptr);
+                        }
                     }
-                    enter(atl__env->tokbuf);
+                    enter(atl__env->tokptr, atl__env->toklen);
                 } else {
-                    di = lookup(atl__env->tokbuf);
+                    di = lookup(atl__env->tokptr, atl__env->toklen);
                     if (di != NULL) {
                         /* Test the state.  If we're interpreting, execute
                          the word in all cases.  If we're compiling,
@@ -4003,11 +9110,15 @@ int atl_eval(char *sp) {
                                 Ho(1);	  /* Reserve stack space */
                                 Hstore = (stackitem) di;/* Compile word address */
                             } else {
+                                atl__env->execNesting++;
                                 exword(di);   /* Execute word */
+                                atl__env->execNesting--;
                             }
+                    } else if (parseint(atl__env->tokptr, atl__env->toklen, &atl__env->tokint)) {
+                        goto tokint;  /* A number starting with a letter digit, as in hex */
                     } else {
 #ifdef MEMMESSAGE
-                        fprintf(stderr, " '%s' undefined ", atl__env->tokbuf);
+                        fprintf(stderr, " '%.*s' undefined ", (int) atl__env->toklen, atl__env->tokptr);
 #endif
                         atl__env->evalStatus = ATL_UNDEFINED;
                         state = atlFalsity;
@@ -4016,6 +9127,7 @@ int atl_eval(char *sp) {
                 break;
 
             case TokInt:
+            tokint:
                 if (state) {
                     Ho(2);
                     Hstore = atl__env->s_lit;   /* Push (lit) */
@@ -4041,6 +9153,10 @@ int atl_eval(char *sp) {
                         Hstore = tru.s[i];
                     }
                 } else {
+#ifdef FPSTACK
+                    Fso(1);
+                    Fpush = atl__env->tokreal;
+#else
                     int i;
     	    	    union {
                         atl_real r;
@@ -4052,6 +9168,7 @@ int atl_eval(char *sp) {
                     for (i = 0; i < Realsize; i++) {
                         Push = tru.s[i];
                     }
+#endif
                 }
                 break;
 
@@ -4059,29 +9176,29 @@ int atl_eval(char *sp) {
                 if (atl__env->tokPendingStringLiteral) {
                     atl__env->tokPendingStringLiteral = atlFalse;
                     if (state) {
-                        size_t l = (strlen(atl__env->tokbuf) + 1 + sizeof(stackitem)) /
-                        sizeof(stackitem);
-                        Ho(l);
-                        *((char *) atl__env->heapAllocPtr) = l;  /* Store in-line skip length */
-                        strcpy(((char *) atl__env->heapAllocPtr) + 1, atl__env->tokbuf);
-                        atl__env->heapAllocPtr += l;
+                        Ho(1 + (atl__env->toklen + sizeof(stackitem)) / sizeof(stackitem));
+                        strcompile();
                     } else {
-                        fprintf(stderr, "%s", atl__env->tokbuf);
+                        char *t = alloc((unsigned int) atl__env->toklen + 1);
+
+                        strdecode(t, atl__env->tokptr, atl__env->toklen, atl__env->toklen);
+                        fprintf(stderr, "%s", t);
+                        free(t);
                     }
                 } else {
                     if (state) {
-                        size_t l = (strlen(atl__env->tokbuf) + 1 + sizeof(stackitem)) /
-                        sizeof(stackitem);
-                        Ho(l + 1);
+                        Ho(2 + (atl__env->toklen + sizeof(stackitem)) / sizeof(stackitem));
                         /* Compile string literal instruction, followed by
-                         in-line skip length and the string literal */
+                         the string literal */
                         Hstore = atl__env->s_strlit;
-                        *((char *) atl__env->heapAllocPtr) = l;  /* Store in-line skip length */
-                        strcpy(((char *) atl__env->heapAllocPtr) + 1, atl__env->tokbuf);
-                        atl__env->heapAllocPtr += l;
+                        strcompile();
                     } else {
                         So(1);
-                        strcpy(atl__env->strbuf[atl__env->idxCurrTempStringBuffer], atl__env->tokbuf);
+                        if (strdecode(atl__env->strbuf[atl__env->idxCurrTempStringBuffer], atl__env->tokptr, atl__env->toklen,
+                                      (size_t) atl__env->lengthTempStringBuffer - 1) >= (size_t) atl__env->lengthTempStringBuffer) {
+                            longstring();
+                            break;
+                        }
                         Push = (stackitem) atl__env->strbuf[atl__env->idxCurrTempStringBuffer];
                         atl__env->idxCurrTempStringBuffer = (atl__env->idxCurrTempStringBuffer + 1) % ((int) atl__env->numberOfTempStringBuffers);
                     }
@@ -4093,6 +9210,9 @@ int atl_eval(char *sp) {
                 break;
         }
     }
+#ifdef STACKGUARD
+    atl__env->guardCatch = g.outer;
+#endif
     return atl__env->evalStatus;
 }
 // end of ATLast/atlast.c
@@ -0,0 +1,72 @@
+/*
+
+	Benchmark driver for the interpreter in ../ATLast
+
+	Loads each file named on the command line into a fresh
+	interpreter and reports how long that took and how many tokens
+	(blank separated words, comments included) a second it came to.
+	Define ATLNEWSRC as the path of another main.c, in quotes, to
+	time that version instead.
+
+*/
+
+#ifndef ATLNEWSRC
+#define ATLNEWSRC "../ATLast/main.c"
+#endif
+
+#define main atlast_main
+#include ATLNEWSRC
+#undef main
+
+#include <time.h>
+
+/*  TOKENS  --  Count the blank separated words in a file.  */
+
+static long tokens(const char *name)
+{
+    FILE *fp = fopen(name, "r");
+    long n = 0;
+    int c, blank = 1;
+
+    if (fp == NULL) {
+	return 0;
+    }
+    while ((c = getc(fp)) != EOF) {
+	if (isspace(c)) {
+	    blank = 1;
+	} else if (blank) {
+	    blank = 0;
+	    n++;
+	}
+    }
+    fclose(fp);
+    return n;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *searchPath[] = {"", 0};
+    struct timespec start, end;
+    double s;
+    long n;
+    int i, status;
+
+    for (i = 1; i < argc; i++) {
+	atl__env = atl__NewInterpreter();
+	atl__env->heapLength = 1L << 22;
+	atl__env->stkLength = 1000;
+	atl__env->rsLength = 1000;
+	atl_init();
+	n = tokens(argv[i]);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	status = atl__LoadFile(searchPath, argv[i]);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	s = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%s: %ld tokens in %.3f s, %.0f tokens/s%s\n", argv[i], n, s,
+	    s > 0 ? n / s : 0.0, status == ATL_SNORM ? "" : " (FAILED)");
+	if (status != ATL_SNORM) {
+	    return 1;
+	}
+    }
+    return 0;
+}
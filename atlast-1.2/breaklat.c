@@ -0,0 +1,87 @@
+/*
+
+	Break latency test for the interpreter in ../ATLast
+
+	Each loop below runs forever until SIGALRM calls atl__Break().
+	The time from the signal to atl_eval() returning ATL_BREAK is
+	the break latency.  Breaks are polled only where execution loops
+	back or nests, so it is bounded by one pass of the loop; the
+	last loop has a long straight-line body to show that bound.  The
+	test fails if a loop isn't stopped, or takes longer than
+	MAXLATENCY microseconds to stop.
+
+*/
+
+#define main atlast_main
+#include "../ATLast/main.c"
+#undef main
+
+#include <sys/time.h>
+#include <time.h>
+
+#define ALARM	    20000	      /* Microseconds each loop runs */
+#define MAXLATENCY  10000	      /* Microseconds allowed to stop */
+#define BODY	    500 	      /* DUP DROP pairs in the long body */
+
+static struct timespec signalled;
+
+static void alarmed(int sig)
+{
+    (void) sig;
+    clock_gettime(CLOCK_MONOTONIC, &signalled);
+    atl__Break();
+}
+
+static char *loops[] = {
+    ": t begin again ;",
+    ": t begin 0 until ;",
+    ": t begin 1 while repeat ;",
+    ": t begin 1000 0 do loop again ;",
+    ": t begin 1000 0 do 2 +loop again ;",
+    ": n ; : t begin n again ;",
+    ": t 1 begin dup 0= until ;",
+    NULL			      /* Long body, built below */
+};
+
+int main()
+{
+    static char body[32 + BODY * 9];
+    struct itimerval it;
+    struct timespec now;
+    long us, worst = 0;
+    int i, status, failed = 0;
+
+    atl__env = atl__NewInterpreter();
+    atl__env->heapLength = 20000;     /* Room for the long body */
+    atl_init();
+    signal(SIGALRM, alarmed);
+
+    strcpy(body, ": t 0 begin");
+    for (i = 0; i < BODY; i++) {
+	strcat(body, " dup drop");
+    }
+    strcat(body, " again ;");
+    loops[(sizeof loops / sizeof loops[0]) - 1] = body;
+
+    for (i = 0; i < (int) (sizeof loops / sizeof loops[0]); i++) {
+	atl_eval(loops[i]);
+	memset(&it, 0, sizeof it);
+	it.it_value.tv_usec = ALARM;
+	setitimer(ITIMER_REAL, &it, NULL);
+	status = atl_eval("t");
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	us = (now.tv_sec - signalled.tv_sec) * 1000000L +
+	     (now.tv_nsec - signalled.tv_nsec) / 1000;
+	printf("%-44.44s %s %6ld us\n", loops[i],
+	    status == ATL_BREAK ? "stopped" : "NOT STOPPED", us);
+	if (status != ATL_BREAK || us > MAXLATENCY) {
+	    failed = 1;
+	}
+	if (us > worst) {
+	    worst = us;
+	}
+	atl_eval("clear forget t");
+    }
+    printf("Worst break latency %ld us: %s\n", worst, failed ? "FAILED" : "passed");
+    return failed;
+}